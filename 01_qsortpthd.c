@@ -1,7 +1,40 @@
 //Thomas Van Klaveren assignment 1
 //Parallel Programming
-//A global array of size N contains the integers to be sorted
-//A global task queue is initialized with the sort range [0, N-1]
+//Driver for the persistent pthread sorting pool (qsortpool.h): the
+//pool's workers are started once and sort <batches> copies of the
+//input as concurrent jobs
+//
+//Usage: ./qsortpthd [-d <dist>] [-s <seed>] [-a <policy>] [-m <mode>]
+//                   [-k <k>] [-b <batches>] <N> <num_thread>
+//  -d  input distribution (see sort_input.h), default random
+//  -s  random seed, default time(NULL)
+//  -a  thread placement (see affinity.h): none, compact, scatter or a
+//      cpu list; default none.  With a policy the array pages are first
+//      touched by the pinned workers block by block, and workers prefer
+//      queued tasks whose range starts on their own NUMA node.
+//  -m  sort mode: quick (default), merge (parallel merge sort, see
+//      msort.h) or record (stable merge sort of key+payload records
+//      built from the input, payload = input position).
+//      Selection modes only partition the ranges holding the ranks
+//      asked for (qsort_submit_ranks): select (element of rank k in
+//      place, smaller ones before it, larger after; default k = N/2,
+//      the median), partial (the k smallest sorted at the front) or
+//      topk (the k largest sorted at the end); default k = N/100
+//  -b  number of copies of the input submitted together, default 1;
+//      the sort time covers all of them
+//
+//Compile with the pool:
+//  gcc -pthread -o qsortpthd 01_qsortpthd.c qsortpool.c -lm
+//and add -DTRACE to qsortpool.c for per-thread counters (tasks,
+//elements, time partitioning, waiting on length_cond, acquiring and
+//holding queue_lock, queue-depth samples).  They are written when the
+//pool is destroyed in Chrome trace format to $QSORT_TRACE (default
+//qsort_trace.json); load it in chrome://tracing or Perfetto.
+//
+//The result is verified in parallel: every thread checks the order of
+//its slice (and across the boundary with the next slice), and the
+//order-independent checksum of the result must match the input's.
+//
 
 
 #define _GNU_SOURCE
@@ -11,90 +44,31 @@
 #include <sched.h>
 #include <unistd.h>
 #include <time.h>
+#include <stdint.h>
+#include <getopt.h>
+#include "sort_input.h"
+#include "affinity.h"
+#include "checksum.h"
+#include "qsortpool.h"
 
-//threshhold for switching to bubble sort
-#define MINSIZE 10 
 
 
+//global shared variables
+int N = 0;
+int sort_mode = QSORT_QUICK;
 
-//----------------------------------------------------------------------
-//Task and queue representaions
-typedef struct task_ {
-  int low;
-  int high;
-  struct task_ *next;
-} task_t;
-
-typedef struct queue_{
-  task_t *head;
-  task_t *tail;
-  int length;
-} queue_t;
-
-//create a new task
-task_t *create_task(int low, int high){
-  task_t *task = (task_t *) malloc(sizeof(task_t));
-  task->low = low;
-  task->high = high;
-  task->next = NULL;
-  return task;
-}
-
-//initialize the task queue
-queue_t *init_queue(){
-  queue_t *queue = (queue_t *) malloc(sizeof(queue_t));
-  queue->head = queue->tail = NULL;
-  queue->length = 0;
-  return queue;
-}
-
-//add a task to tail of queue
-void add_task(queue_t *queue, task_t *task){
-  if(!queue->tail){
-    queue->head = queue->tail = task;
-  }
-  else{
-    queue->tail->next = task;
-    queue->tail = task;
-  }
-
-  queue->length++;
-}
-
-//remove a task from the head of the queue (return NULL if empty)
-task_t *remove_task(queue_t *queue){
-  task_t *task = NULL;
-
-  if(queue->length > 0){
-    task = queue->head;
-
-    if(queue->head == queue->tail){
-      queue->head = queue->tail = NULL;
-    }
-    else{
-      queue->head = queue->head->next;
-    }
-
-    queue->length--;
-  }
+//ranks put in place: 0..N-1 for a full sort, fewer in selection modes
+int rank_lo = 0, rank_hi = -1;
 
-  return task;
-}
-//-------------------------------------------------------------------------
+//thread placement of the verification threads, same policy as the pool
+affinity_t affinity;
+int num_thread = 1;
 
-//global shared variables (array, queue, count, mutex lock)
-int *array = NULL;
-queue_t *queue;
-int count = 0;
-int N = 0;
-pthread_mutex_t queue_lock;
-pthread_mutex_t sum_lock;
-pthread_cond_t length_cond;
 
 //print array for testing purposes
 void print_array(int *array, int low, int high){
   printf("low = %d, a[%d] = %d\n"
-         "high = %d, a[%d] = %d\n", 
+         "high = %d, a[%d] = %d\n",
           low+1, low+1, array[low], high, high, array[high-1]);
   for(int i = 0; i<N; i++){
     printf("%d ", array[i]);
@@ -102,254 +76,320 @@ void print_array(int *array, int low, int high){
   printf("\n");
 }
 
-//swap 2 elements of an array
-void swap(int *array, int i, int j){
-  if (i == j){
-    return;
-  }
-
-  int temp = array[i];
-  array[i] = array[j];
-  array[j] = temp;
-}
-
-
-//initialize an array of N elements
-//1. geneate [1, 2, 3, ... N]
-//2. perform a random permutation
-int *init_array(int N){
+//initialize an array of N elements from input distribution dist
+//(a random permutation of [1..N] by default), exit on bad input
+int *init_array(qsort_pool_t *pool, int N, const char *dist, uint64_t seed){
   int *array = (int *) malloc(sizeof(int) * N);
 
-  for (int i = 0; i < N; i++){
-    array[i] = i + 1;
+  //with a placement policy, touch the pages from the pinned workers
+  //before filling in the values
+  if(affinity.ncpus > 0){
+    qsort_pool_touch(pool, array, N);
   }
 
-  srand(time(NULL));
-  for (int i = 0; i < N; i++){
-    int j = (rand() * 1./RAND_MAX) * (N-1);
-    swap(array, i, j);
+  if(gen_input(array, N, dist, seed) < 0){
+    exit(1);
   }
 
-  printf("Initialized array to a random permutation of [1..%d]\n", N);
+  printf("Initialized array of %d elements (%s, seed %llu)\n",
+         N, dist, (unsigned long long) seed);
   return array;
 }
 
-//verify the result
-void verify_array(int *array, int N){
-  for (int i = 0; i < N-1; i++){
-    if (array[i] > array[i+1]){
-      printf("FAILED: array[%d] = %d, array[%d] = %d\n", 
-             i, array[i], i+1, array[i+1]);
-      return;
-    }
-  }
 
-  printf("Result verified!\n");
+
+//----------------------------------------------------------------------
+//Parallel verification: thread k hashes its slice of the array (or
+//records) into a checksum and, if asked, finds the first element in
+//the slice that is out of order with the next one
+typedef struct verify_ {
+  long k;
+  int *array;
+  record_t *records;	//checked instead of array if not NULL
+  int check;		//also check the order, not just the checksum
+  long bad;		//first out-of-order index in the slice, -1 if none
+  checksum_t sum;
+} verify_t;
+
+//records hash key and payload together
+static inline uint64_t record_bits(record_t r){
+  return ((uint64_t)(uint32_t) r.key << 32) | (uint32_t) r.payload;
 }
 
-//bubble sort for the base cases
-void bubblesort(int *array, int low, int high){
-  if(low >= high){
-    return;
+void *verify_block(void *arg){
+  verify_t *v = (verify_t *) arg;
+  long low = (long) N * v->k / num_thread;
+  long high = (long) N * (v->k+1) / num_thread;
+  int *array = v->array;
+  record_t *records = v->records;
+
+  affinity_pin(&affinity, v->k);
+  checksum_init(&v->sum);
+  v->bad = -1;
+  if(records){
+    for(long i = low; i < high; i++){
+      checksum_add(&v->sum, record_bits(records[i]));
+      if(v->check && v->bad < 0 && i+1 < N &&
+         (records[i].key > records[i+1].key ||
+          (records[i].key == records[i+1].key &&
+           records[i].payload > records[i+1].payload))){
+        v->bad = i;
+      }
+    }
   }
-
-  for(int i = low; i <= high; i++){
-    for(int j = i+1; j <= high; j++){
-      if(array[i] > array[j]){
-        swap(array, i, j);
+  else{
+    //ranks rank_lo..rank_hi sorted, nothing larger before them and
+    //nothing smaller after them
+    for(long i = low; i < high; i++){
+      checksum_add(&v->sum, (uint32_t) array[i]);
+      if(v->check && v->bad < 0 &&
+         ((i >= rank_lo && i < rank_hi && array[i] > array[i+1]) ||
+          (i < rank_lo && array[i] > array[rank_lo]) ||
+          (i > rank_hi && array[i] < array[rank_hi]))){
+        v->bad = i;
       }
     }
   }
+  return NULL;
 }
 
-//pick element as pivot
-//rearrange array elements into [smaller elements, pivot, larger elements]
-//retunr pivot's final index
-int partition(int *array, int low, int high){
-  int pivot = array[high];
-  int middle = low;
-
-  for(int i = low; i < high; i++){
-    if(array[i] < pivot){
-      swap(array, i, middle);
-      middle++;
+//scan the data with num_thread threads, return the checksum and set
+//*bad to the first out-of-order index (-1 if in order)
+checksum_t scan_parallel(int *array, record_t *records, int check,
+                         long *bad){
+  pthread_t thread[num_thread];
+  verify_t v[num_thread];
+  checksum_t sum;
+
+  for(long k = 0; k < num_thread; k++){
+    v[k].k = k;
+    v[k].array = array;
+    v[k].records = records;
+    v[k].check = check;
+    pthread_create(&thread[k], NULL, verify_block, &v[k]);
+  }
+  checksum_init(&sum);
+  *bad = -1;
+  for(long k = 0; k < num_thread; k++){
+    pthread_join(thread[k], NULL);
+    checksum_merge(&sum, &v[k].sum);
+    if(*bad < 0){
+      *bad = v[k].bad;
     }
   }
-
-  swap(array, high, middle);
-  return middle;
+  return sum;
 }
 
-
-//quicksort an array
-void quicksort(int *array, int low, int high){
-  if(high - low < MINSIZE){
-    bubblesort(array, low, high);
-
-    //update global count 
-    pthread_mutex_lock(&sum_lock);
-    count += (high - low)+1;
-
-    //add dummy task if global count > N
-    if(count >= N){
-      pthread_mutex_unlock(&sum_lock);
-      task_t *dummy = NULL;
-      dummy = create_task(0, 0);
-      pthread_mutex_lock(&queue_lock);
-      add_task(queue, dummy);
-
-      //signal waiting condition since queue length increase
-      pthread_cond_signal(&length_cond);
-      pthread_mutex_unlock(&queue_lock);
-    }
-
-    else{
-      pthread_mutex_unlock(&sum_lock);
-    }
-
+//verify a result: in order (equal record keys still in input order)
+//and the same elements as the input
+void verify_result(int *array, record_t *records, checksum_t input){
+  long bad;
+  double begin = wall_time();
+  checksum_t output = scan_parallel(array, records, 1, &bad);
+
+  printf("Verify time: %f sec\n", wall_time() - begin);
+  if(bad >= 0 && records){
+    printf("FAILED: rec[%ld] = (%d, %d), rec[%ld] = (%d, %d)\n",
+           bad, records[bad].key, records[bad].payload,
+           bad+1, records[bad+1].key, records[bad+1].payload);
     return;
   }
-
-  //partition the array
-  int middle = partition(array, low, high);
-
-  //update global count and add dummy task if count > N
-  pthread_mutex_lock(&sum_lock);
-  count++;
-
-  if(count >= N){
-    pthread_mutex_unlock(&sum_lock);
-    task_t *dummy = NULL;
-    dummy = create_task(0, 0);
-    pthread_mutex_lock(&queue_lock);
-    add_task(queue, dummy);
-
-    //signal waiting condition since queue length increase
-    pthread_cond_signal(&length_cond);
-    pthread_mutex_unlock(&queue_lock);
-  }
-
-  else{
-    pthread_mutex_unlock(&sum_lock);
+  if(bad >= rank_lo && bad < rank_hi){
+    printf("FAILED: array[%ld] = %d, array[%ld] = %d\n",
+           bad, array[bad], bad+1, array[bad+1]);
+    return;
   }
-
-  if (low < middle){
-    //create task and add to queue for next avail thread
-    //for the array elements on the left side of the partition
-    task_t *task = NULL;
-    task = create_task(low, middle-1);
-    pthread_mutex_lock(&queue_lock);
-    add_task(queue, task);
-    //signal waiting threads to wake up for new task on queue
-    pthread_cond_signal(&length_cond);
-    pthread_mutex_unlock(&queue_lock);
+  if(bad >= 0){
+    printf("FAILED: array[%ld] = %d is on the wrong side of ranks %d..%d\n",
+           bad, array[bad], rank_lo, rank_hi);
+    return;
   }
-
-
-  if (middle < high){
-    //recursively quicksort on the elements 
-    //on the right side of the partition
-    quicksort(array, middle+1, high); 
+  if(!checksum_equal(&input, &output)){
+    printf("FAILED: checksum of the result does not match the input\n");
+    return;
   }
-}
-
-
-//worker routine that each thread will call
-void worker(long wid){
-  printf("worker %ld started on %d\n", wid, sched_getcpu());
-  int l_count = 0;
-  task_t *task;
-
-  //the following will repeat if the count is less than
-  //the array size at the end of the block
-  do{
-    pthread_mutex_lock(&sum_lock);
-    l_count = count;
-    pthread_mutex_unlock(&sum_lock);
-
-    //if the local count is less than the array size
-    //access the queue and wait for a task if the 
-    //queue is empty
-    if(l_count < N){
-      pthread_mutex_lock(&queue_lock);
-      while(queue->length < 1){
-        pthread_cond_wait(&length_cond, &queue_lock); 
-      }
 
-      //after wake up from waiting, get task and quicksort
-      task = remove_task(queue);
-      pthread_mutex_unlock(&queue_lock);
-      quicksort(array, task->low, task->high);
-    }
-
-    pthread_mutex_lock(&sum_lock);
-    l_count = count;
-    pthread_mutex_unlock(&sum_lock);
-  }while (l_count < N);
-     
+  printf("Result verified!\n");
 }
-
+//----------------------------------------------------------------------
 
 
 //main routine
 int main(int argc, char **argv){
 
 
-  //default number of threads
-  int num_thread = 1;
+  //default input distribution, seed and placement
+  const char *dist = "random";
+  const char *policy = "none";
+  uint64_t seed = time(NULL);
+  int batches = 1;
+  int select_mode = 0;	//selection mode: 's'elect, 'p'artial or 't'opk
+  int k = -1;
+  int opt;
 
   //check user inputs
-  if(argc < 2){
-    printf("Usage:  ./qsortpthrd <N> <num_thread>\n");
+  while((opt = getopt(argc, argv, "d:s:a:m:k:b:")) != -1){
+    switch(opt){
+    case 'd':
+      dist = optarg;
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'a':
+      policy = optarg;
+      break;
+    case 'm':
+      if(strcmp(optarg, "quick") == 0){
+        sort_mode = QSORT_QUICK;
+      }
+      else if(strcmp(optarg, "merge") == 0){
+        sort_mode = QSORT_MERGE;
+      }
+      else if(strcmp(optarg, "record") == 0){
+        sort_mode = QSORT_RECORD;
+      }
+      else if(strcmp(optarg, "select") == 0 ||
+              strcmp(optarg, "partial") == 0 ||
+              strcmp(optarg, "topk") == 0){
+        sort_mode = QSORT_QUICK;
+        select_mode = optarg[0];
+      }
+      else{
+        printf("<mode> must be quick, merge, record, select, partial "
+               "or topk\n");
+        exit(0);
+      }
+      break;
+    case 'k':
+      k = atoi(optarg);
+      break;
+    case 'b':
+      if((batches = atoi(optarg)) < 1){
+        printf("<batches> must be greater than 0\n");
+        exit(0);
+      }
+      break;
+    default:
+      printf("Usage:  ./qsortpthrd [-d <dist>] [-s <seed>] [-a <policy>] "
+             "[-m <mode>] [-k <k>] [-b <batches>] <N> <num_thread>\n");
+      exit(0);
+    }
+  }
+
+  if(argc - optind < 2){
+    printf("Usage:  ./qsortpthrd [-d <dist>] [-s <seed>] [-a <policy>] "
+           "[-m <mode>] [-k <k>] [-b <batches>] <N> <num_thread>\n");
     exit(0);
   }
 
-  if((N = atoi(argv[1])) < 2){
+  if((N = atoi(argv[optind])) < 2){
     printf("<N> must be greater than 2\n");
     exit(0);
   }
 
-  if((num_thread = atoi(argv[2])) < 1){
+  if((num_thread = atoi(argv[optind+1])) < 1){
     printf("<num_thread> must be greater than 0\n");
     exit(0);
   }
 
+  //window of ranks to put in place
+  rank_hi = N-1;
+  if(select_mode == 's'){
+    rank_lo = rank_hi = (k < 0) ? N/2 : k;
+  }
+  else if(select_mode == 'p'){
+    rank_hi = ((k < 0) ? (N/100 > 0 ? N/100 : 1) : k) - 1;
+  }
+  else if(select_mode == 't'){
+    rank_lo = N - ((k < 0) ? (N/100 > 0 ? N/100 : 1) : k);
+  }
+  if(rank_lo < 0 || rank_hi >= N || rank_lo > rank_hi){
+    printf("<k> must be a rank (select) or a count (partial, topk) "
+           "that fits in N\n");
+    exit(0);
+  }
 
-  //initialize array, queue, locks
-  array = init_array(N);
-
-  queue = init_queue();
+  if(affinity_init(&affinity, policy) < 0){
+    exit(0);
+  }
 
-  pthread_t thread[num_thread];
 
-  pthread_mutex_init(&queue_lock, NULL);
-  pthread_mutex_init(&sum_lock, NULL);
-  pthread_cond_init(&length_cond, NULL);
+  //start the workers once, then initialize the array
+  qsort_pool_t *pool = qsort_pool_create(num_thread, policy);
+  printf("%d threads created\n", num_thread);
+  int *array = init_array(pool, N, dist, seed);
+
+  //one copy of the input per batch (records built from it in record
+  //mode), each first touched by the workers
+  size_t size = (sort_mode == QSORT_RECORD) ? sizeof(record_t) : sizeof(int);
+  void *data[batches];
+  for(int b = 0; b < batches; b++){
+    if(sort_mode == QSORT_RECORD){
+      record_t *records = (record_t *) malloc(size * N);
+      for(int i = 0; i < N; i++){
+        records[i].key = array[i];
+        records[i].payload = i;
+      }
+      data[b] = records;
+    }
+    else if(b == 0){
+      data[b] = array;
+    }
+    else{
+      data[b] = malloc(size * N);
+      if(affinity.ncpus > 0){
+        qsort_pool_touch(pool, data[b], N);
+      }
+      memcpy(data[b], array, size * N);
+    }
+  }
 
-  //create first task
-  task_t *task_one = NULL;
-  task_one = create_task(0, N-1);
-  pthread_mutex_lock(&queue_lock);
-  add_task(queue, task_one);
-  pthread_mutex_unlock(&queue_lock);
+  //checksum of the input, compared with each result after the sort
+  long unused;
+  record_t *rec0 = (sort_mode == QSORT_RECORD) ? data[0] : NULL;
+  checksum_t input_sum = scan_parallel(data[0], rec0, 0, &unused);
 
+  //time the sort from the first submit to the last completion
+  double begin = wall_time();
 
-  //create numThreads-1 worker threads to execute worker()
-  for (long k = 0; k < num_thread - 1; k++){
-    pthread_create(&thread[k], NULL, (void*)worker, (void*)k);
+  qsort_job_t *job[batches];
+  for(int b = 0; b < batches; b++){
+    if(select_mode){
+      job[b] = qsort_submit_ranks(pool, data[b], N, rank_lo, rank_hi);
+    }
+    else{
+      job[b] = qsort_submit(pool, data[b], N, sort_mode);
+    }
+  }
+  for(int b = 0; b < batches; b++){
+    qsort_wait(job[b]);
   }
-  
-  //make main thread run worker()
-  worker(num_thread - 1);
-  printf("%d threads created\n", num_thread);
 
-  //main thread waits for worker threads to join
-  for (long k = 0; k < num_thread - 1; k++){
-    pthread_join(thread[k], NULL);
+  printf("Sort time: %f sec\n", wall_time() - begin);
+
+  qsort_pool_destroy(pool);
+
+  if(select_mode){
+    int *result = data[0];
+    printf("Ranks %d..%d: %d .. %d\n", rank_lo, rank_hi,
+           result[rank_lo], result[rank_hi]);
   }
 
-  //varify the result
-  verify_array(array, N);
+  //varify the results
+  for(int b = 0; b < batches; b++){
+    if(sort_mode == QSORT_RECORD){
+      verify_result(NULL, data[b], input_sum);
+    }
+    else{
+      verify_result(data[b], NULL, input_sum);
+    }
+    if(data[b] != array){
+      free(data[b]);
+    }
+  }
+  free(array);
+  affinity_free(&affinity);
 
 return 0;
 }
@@ -5,43 +5,75 @@
 
 // A sequential prime-finding algorithm.
 //
-// Usage: ./prime <N>
+// Usage: ./prime [-a <policy>] <N> <num_thread>
+//   -a  thread placement (see affinity.h), default none
+//
+// Thread t of P owns the block array[first(t)..first(t+1)-1] of 2..N:
+// it touches those pages first, crosses out the multiples that fall in
+// them and counts the primes there.  Every parallel loop runs over the
+// P blocks with a static schedule, so block t stays on thread t.
 // 
 //
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <getopt.h>
 #include <omp.h>
+#include "affinity.h"
+
+// First index of thread t's block of 2..N, for P threads
+//
+static inline long first(long N, int P, int t) {
+  return 2 + (N - 1) * t / P;
+}
 
 int main(int argc, char **argv) {
   long N;
   int num_thread;
+  const char *policy = "none";
+  affinity_t affinity;
+  int opt;
 
   /* check command line first */
-  if (argc < 3) {
-    printf ("Usage: ./prime_omp <N> <num_thread>\n");
+  while ((opt = getopt(argc, argv, "a:")) != -1) {
+    if (opt != 'a') {
+      printf ("Usage: ./prime_omp [-a <policy>] <N> <num_thread>\n");
+      exit(0);
+    }
+    policy = optarg;
+  }
+  if (argc - optind < 2) {
+    printf ("Usage: ./prime_omp [-a <policy>] <N> <num_thread>\n");
     exit(0);
   }
-  if ((N=atoi(argv[1])) < 2) {
+  if ((N=atoi(argv[optind])) < 2) {
     printf ("N must be greater than 1\n");
     exit(0);
   }
-  if ((num_thread = atoi(argv[2])) < 1){
+  if ((num_thread = atoi(argv[optind+1])) < 1){
     printf("<num_thread> must be greater than 0\n");
     exit(0);
   }
+  if (affinity_init(&affinity, policy) < 0)
+    exit(0);
 
   omp_set_num_threads(num_thread);
 
+  // pin the OpenMP threads once; the runtime keeps reusing them
+  #pragma omp parallel
+  affinity_pin(&affinity, omp_get_thread_num());
+
 #ifdef DEBUG
   printf("Finding primes in range 1..%d\n", N);
 #endif
 
   long *array = (long *) malloc(sizeof(long) * (N+1));
 
-  #pragma omp parallel for
-  for (int i = 2; i <= N; i++){
-    array[i] = 1;
+  #pragma omp parallel for schedule(static)
+  for (int t = 0; t < num_thread; t++) {
+    for (long i = first(N, num_thread, t); i < first(N, num_thread, t+1); i++)
+      array[i] = 1;
 //    printf("updated array on thread %d\n", omp_get_thread_num());
   }
 
@@ -56,12 +88,19 @@ int main(int argc, char **argv) {
 //    #pragma omp task firstprivate(i)
     if (array[i] == 1) {
 //      printf("cancelling mults of %d on thread %d\n", i, omp_get_thread_num());
-      #pragma omp parallel for firstprivate(i)
+      #pragma omp parallel for schedule(static) firstprivate(i)
 //      #pragma omp single firsteprivate(i)
-      for (int j = i+i; j <= N; j += i){
-//        #pragma omp task firstprivate(j) 
-	array[j] = 0;
-//        printf("found nonprime of %d on thread %d\n", i, omp_get_thread_num());
+      for (int t = 0; t < num_thread; t++) {
+        //first multiple of i in my block, from i+i on
+        long lo = first(N, num_thread, t), hi = first(N, num_thread, t+1);
+        long j = (lo + i - 1) / i * i;
+        if (j < i+i)
+          j = i+i;
+        for (; j < hi; j += i) {
+//          #pragma omp task firstprivate(j) 
+	  array[j] = 0;
+//          printf("found nonprime of %d on thread %d\n", i, omp_get_thread_num());
+        }
       }
     }
   }
@@ -76,18 +115,21 @@ int main(int argc, char **argv) {
 }
 printf("\n\n");
 */
-  #pragma omp parallel for reduction(+:cnt)
-  for (int i = 2; i <= N; i++) {
-    if (array[i] == 1){
-//      omp_set_lock(&cnt_lock);
-//      #pragma omp flush(cnt)
-      cnt++;
-//      printf("found prime on thread %d\n", omp_get_thread_num());
-//      #pragma omp flush(cnt)
-//      omp_unset_lock(&cnt_lock);
+  #pragma omp parallel for schedule(static) reduction(+:cnt)
+  for (int t = 0; t < num_thread; t++) {
+    for (long i = first(N, num_thread, t); i < first(N, num_thread, t+1); i++) {
+      if (array[i] == 1){
+//        omp_set_lock(&cnt_lock);
+//        #pragma omp flush(cnt)
+        cnt++;
+//        printf("found prime on thread %d\n", omp_get_thread_num());
+//        #pragma omp flush(cnt)
+//        omp_unset_lock(&cnt_lock);
+      }
     }
   }
 
   printf("Total %d primes found\n", cnt);
+  affinity_free(&affinity);
 }
 
@@ -5,16 +5,57 @@
 
 // A sequential quicksort program.
 //
-// Usage: ./qsort <N>
+// Usage: ./qsort [-d <dist>] [-s <seed>] [-a <policy>] [-m <mode>]
+//                [-k <k>] <N> <num_thread>
+//   -d  input distribution (see sort_input.h), default random
+//   -s  random seed, default time(NULL)
+//   -a  thread placement (see affinity.h), default none
+//   -m  sort mode: quick (default), merge (parallel merge sort, see
+//       msort.h) or record (stable merge sort of key+payload records
+//       built from the input, payload = input position).
+//       Selection modes only recurse into the ranges holding the ranks
+//       asked for: select (element of rank k in place, smaller ones
+//       before it, larger after; default k = N/2, the median), partial
+//       (the k smallest sorted at the front) or topk (the k largest
+//       sorted at the end); default k = N/100
+//
+// The array pages are first touched in parallel by the OpenMP threads,
+// and each task carries an affinity hint for the range it sorts.
+//
+// The result is verified in parallel: the threads check the order of
+// their share of the result and compute an order-independent checksum
+// that must match the input's.
+//
+// Compile with (-lm for the zipf input in sort_input.h):
+//   gcc -fopenmp -o qsort_omp 02_qsort_omp.c -lm
 // 
 //
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <time.h>
+#include <getopt.h>
 #include <omp.h>
+#include "sort_input.h"
+#include "affinity.h"
+#include "checksum.h"
+
+// parallel merge sort for int arrays and key+payload records
+#define MSORT_T int
+#define MSORT_KEY(e) (e)
+#define MSORT_NAME(f) int_##f
+#include "msort.h"
+#define MSORT_T record_t
+#define MSORT_KEY(e) ((e).key)
+#define MSORT_NAME(f) rec_##f
+#include "msort.h"
 
 #define MINSIZE   10 		// threshold for switching to bubblesort
 
+// ranks put in place: 0..N-1 for a full sort, fewer in selection modes
+int rank_lo, rank_hi;
+
 // Swap two array elements 
 //
 void swap(int *array, int i, int j) {
@@ -24,39 +65,111 @@ void swap(int *array, int i, int j) {
   array[j] = tmp;
 }
 
-// Initialize array.
-// - first generate [1,2,...,N]
-// - then perform a random permutation
+// Initialize array from input distribution <dist>
+// (a random permutation of [1,2,...,N] by default).
 //
-int *init_array(int N)  {
+int *init_array(int N, const char *dist, uint64_t seed)  {
   int *array = (int *) malloc(sizeof(int) * N);
-  for (int i = 0; i < N; i++) {
-    array[i] = i + 1;
-  }
-  srand(time(NULL));
-  for (int i = 0; i < N; i++) {
-    int j = (rand()*1./RAND_MAX) * (N-1);
-    swap(array, i, j);
-  }
+
+  // first touch from the threads that will sort the array
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < N; i++)
+    array[i] = 0;
+
+  if (gen_input(array, N, dist, seed) < 0)
+    exit(1);
 #ifdef DEBUG
-  printf("Initialized array to a random permutation of [1..%d]\n", N);
+  printf("Initialized array of %d elements (%s, seed %llu)\n",
+         N, dist, (unsigned long long) seed);
 #endif
   return array;
 }
 
-// Vverify the result.
+// Records hash key and payload together.
+//
+static inline uint64_t record_bits(record_t r) {
+  return ((uint64_t)(uint32_t) r.key << 32) | (uint32_t) r.payload;
+}
+
+// Checksum of array (or of rec if not NULL) computed in parallel.  If
+// bad is not NULL, also set *bad to the first index that is out of
+// order with the next one (equal record keys must keep payload
+// order), or -1.
 //
-void verify_array(int *array, int N) {
-  for (int i = 0; i < N-1; i++) {
-    if (array[i]>array[i+1]) {
-      printf("FAILED: array[%d]=%d, array[%d]=%d\n", 
-	     i, array[i], i+1, array[i+1]);
-      return;
+checksum_t scan_parallel(int *array, record_t *rec, int N, long *bad) {
+  uint64_t sum = 0, xr = 0;
+  long first = N;
+
+  #pragma omp parallel for schedule(static) \
+          reduction(+:sum) reduction(^:xr) reduction(min:first)
+  for (long i = 0; i < N; i++) {
+    uint64_t h;
+    int order;
+    // ranks rank_lo..rank_hi sorted, nothing larger before them and
+    // nothing smaller after them
+    if (rec) {
+      h = hash64(record_bits(rec[i]));
+      order = i+1 < N && (rec[i].key > rec[i+1].key ||
+                          (rec[i].key == rec[i+1].key &&
+                           rec[i].payload > rec[i+1].payload));
+    }
+    else {
+      h = hash64((uint32_t) array[i]);
+      order = (i >= rank_lo && i < rank_hi && array[i] > array[i+1]) ||
+              (i < rank_lo && array[i] > array[rank_lo]) ||
+              (i > rank_hi && array[i] < array[rank_hi]);
     }
+    sum += h;
+    xr ^= h;
+    if (bad && order && i < first)
+      first = i;
+  }
+
+  if (bad)
+    *bad = (first < N) ? first : -1;
+  checksum_t c = {sum, xr};
+  return c;
+}
+
+// Verify the result: in order and the same elements as the input.
+//
+void verify_result(int *array, record_t *rec, int N, checksum_t input) {
+  long i;
+  double begin = omp_get_wtime();
+  checksum_t output = scan_parallel(array, rec, N, &i);
+
+  printf("Verify time: %f sec\n", omp_get_wtime() - begin);
+  if (i >= 0 && rec) {
+    printf("FAILED: rec[%ld]=(%d,%d), rec[%ld]=(%d,%d)\n",
+	   i, rec[i].key, rec[i].payload, i+1, rec[i+1].key, rec[i+1].payload);
+    return;
+  }
+  if (i >= rank_lo && i < rank_hi) {
+    printf("FAILED: array[%ld]=%d, array[%ld]=%d\n", 
+	   i, array[i], i+1, array[i+1]);
+    return;
+  }
+  if (i >= 0) {
+    printf("FAILED: array[%ld]=%d is on the wrong side of ranks %d..%d\n",
+	   i, array[i], rank_lo, rank_hi);
+    return;
+  }
+  if (!checksum_equal(&input, &output)) {
+    printf("FAILED: checksum of the result does not match the input\n");
+    return;
   }
   printf("Result verified!\n");
 }
 
+// Barrier for the merge sort, called inside the parallel region.  The
+// argument is the one the pthreads version passes to its barrier; an
+// OpenMP barrier needs none.
+//
+void omp_sync(void *arg) {
+  (void) arg;
+  #pragma omp barrier
+}
+
 // Bubble sort for the base cases
 //
 void bubblesort(int *array, int low, int high) {
@@ -68,42 +181,67 @@ void bubblesort(int *array, int low, int high) {
 	swap(array, i, j);
 }
 
-// Pick an arbitrary element as pivot. Rearrange array 
-// elements into [smaller one, pivot, larger ones].
-// Return pivot's index.
+// Index of the median of array[a], array[b] and array[c]
 //
-int partition(int *array, int low, int high) {
-  int pivot = array[high]; 	// use highest element as pivot 
-  int middle = low;
-  for(int i = low; i < high; i++)
-    if(array[i] < pivot) {
-//      printf("currently in thrd %d\n", omp_get_thread_num());
-      swap(array, i, middle);
-      middle++;
-    }
-  swap(array, high, middle);
-  return middle;
+static inline int median3(int *array, int a, int b, int c) {
+  if (array[a] < array[b])
+    return array[b] < array[c] ? b : (array[a] < array[c] ? c : a);
+  return array[a] < array[c] ? a : (array[b] < array[c] ? c : b);
+}
+
+// Pick the pivot as the median of three medians of three (Tukey's
+// ninther) spread over the range, so sorted, reverse and organpipe
+// input do not make it an extreme. Rearrange array elements into
+// [smaller ones, copies of pivot, larger ones] and return the range
+// of the copies in [*lt, *gt], so runs of equal keys are not
+// partitioned again.
+//
+void partition(int *array, int low, int high, int *lt, int *gt) {
+  int mid = low + (high - low) / 2, s = (high - low) / 8;
+  int pivot = array[median3(array,
+                            median3(array, low, low + s, low + 2*s),
+                            median3(array, mid - s, mid, mid + s),
+                            median3(array, high - 2*s, high - s, high))];
+  int i = low;
+  *lt = low;
+  *gt = high;
+  while (i <= *gt) {
+    if (array[i] < pivot)
+      swap(array, (*lt)++, i++);
+    else if (array[i] > pivot)
+      swap(array, i, (*gt)--);
+    else
+      i++;
+  }
 }
  
-// QuickSort an array range
+// Does [low, high] hold any of the ranks being put in place?
+//
+static inline int has_ranks(int low, int high) {
+  return low <= rank_hi && high >= rank_lo;
+}
+
+// QuickSort an array range, recursing only into the parts that hold
+// ranks rank_lo..rank_hi
 // 
 void quicksort(int *array, int low, int high) {
   if (high - low < MINSIZE) {
     bubblesort(array, low, high);
     return;
   }
-  int middle = partition(array, low, high);
+  int lt, gt;
+  partition(array, low, high, &lt, &gt);
 
-  #pragma omp task
-  if (low < middle){
-//    printf("qsort on %d for thd %d\n", array[middle-1], omp_get_thread_num());
-    quicksort(array, low, middle-1);
+  #pragma omp task affinity(array[low:lt-low])
+  if (low < lt && has_ranks(low, lt-1)){
+//    printf("qsort on %d for thd %d\n", array[lt-1], omp_get_thread_num());
+    quicksort(array, low, lt-1);
   }
 
-  #pragma omp task
-  if (middle < high){
+  #pragma omp task affinity(array[gt+1:high-gt])
+  if (gt < high && has_ranks(gt+1, high)){
 //    printf("qsort on %d for thd %d\n", array[high], omp_get_thread_num());
-    quicksort(array, middle+1, high);
+    quicksort(array, gt+1, high);
   }
 }
  
@@ -111,35 +249,125 @@ void quicksort(int *array, int low, int high) {
 // 
 int main(int argc, char **argv) {
   int *array, N, num_thread;
+  const char *dist = "random";
+  const char *policy = "none";
+  const char *mode = "quick";
+  affinity_t affinity;
+  uint64_t seed = time(NULL);
+  int k = -1;
+  int opt;
   
   // check command line first 
-  if (argc < 3) {
-    printf ("Usage: ./qsort <N>\n");
+  while ((opt = getopt(argc, argv, "d:s:a:m:k:")) != -1) {
+    switch (opt) {
+    case 'd': dist = optarg; break;
+    case 's': seed = strtoull(optarg, NULL, 10); break;
+    case 'a': policy = optarg; break;
+    case 'm': mode = optarg; break;
+    case 'k': k = atoi(optarg); break;
+    default:
+      printf ("Usage: ./qsort [-d <dist>] [-s <seed>] [-a <policy>] "
+              "[-m <mode>] [-k <k>] <N> <num_thread>\n");
+      exit(0);
+    }
+  }
+  if (argc - optind < 2) {
+    printf ("Usage: ./qsort [-d <dist>] [-s <seed>] [-a <policy>] "
+              "[-m <mode>] [-k <k>] <N> <num_thread>\n");
     exit(0);
   }
-  if ((N = atoi(argv[1])) < 2) {
+  if ((N = atoi(argv[optind])) < 2) {
     printf ("<N> must be greater than 2\n");
     exit(0);
   }
-  if ((num_thread = atoi(argv[2])) < 1){
+  if ((num_thread = atoi(argv[optind+1])) < 1){
     printf ("<num_thread> must be greater than 0\n");
+    exit(0);
+  }
+
+  if (strcmp(mode, "quick") && strcmp(mode, "merge") && strcmp(mode, "record") &&
+      strcmp(mode, "select") && strcmp(mode, "partial") && strcmp(mode, "topk")) {
+    printf ("<mode> must be quick, merge, record, select, partial or topk\n");
+    exit(0);
   }
 
+  // window of ranks to put in place
+  rank_lo = 0;
+  rank_hi = N-1;
+  if (mode[0] == 's')
+    rank_lo = rank_hi = (k < 0) ? N/2 : k;
+  else if (mode[0] == 'p')
+    rank_hi = ((k < 0) ? (N/100 > 0 ? N/100 : 1) : k) - 1;
+  else if (mode[0] == 't')
+    rank_lo = N - ((k < 0) ? (N/100 > 0 ? N/100 : 1) : k);
+  if (rank_lo < 0 || rank_hi >= N || rank_lo > rank_hi) {
+    printf ("<k> must be a rank (select) or a count (partial, topk) "
+            "that fits in N\n");
+    exit(0);
+  }
+  if (affinity_init(&affinity, policy) < 0)
+    exit(0);
+
   omp_set_num_threads(num_thread);
 
-  array = init_array(N);
+  // pin the OpenMP threads once; the runtime keeps reusing them
+  #pragma omp parallel
+  affinity_pin(&affinity, omp_get_thread_num());
+
+  array = init_array(N, dist, seed);
 
 #ifdef DEBUG
   printf("Sorting started ...\n");
 #endif
 
-  #pragma omp parallel
-  #pragma omp single
-  quicksort(array, 0, N-1);
+  // record mode sorts (key, input position) pairs
+  record_t *records = NULL;
+  void *scratch = NULL;
+  if (mode[0] == 'r') {
+    records = (record_t *) malloc(sizeof(record_t) * N);
+    for (int i = 0; i < N; i++) {
+      records[i].key = array[i];
+      records[i].payload = i;
+    }
+    scratch = malloc(sizeof(record_t) * N);
+  }
+  else if (mode[0] == 'm') {
+    scratch = malloc(sizeof(int) * N);
+  }
+
+  // checksum of the input, compared with the result's after the sort
+  checksum_t input_sum = scan_parallel(array, records, N, NULL);
+
+  double begin = omp_get_wtime();
+
+  if (mode[0] != 'm' && mode[0] != 'r') {
+    #pragma omp parallel
+    #pragma omp single
+    quicksort(array, 0, N-1);
+  }
+  else {
+    #pragma omp parallel
+    {
+      int tid = omp_get_thread_num(), P = omp_get_num_threads();
+      if (records)
+        rec_parallel(records, scratch, N, tid, P, omp_sync, NULL);
+      else
+        int_parallel(array, scratch, N, tid, P, omp_sync, NULL);
+    }
+  }
+
+  printf("Sort time: %f sec\n", omp_get_wtime() - begin);
 
 #ifdef DEBUG
   printf("... completed.\n");
 #endif
 
-  verify_array(array, N);
+  if (mode[0] == 's' || mode[0] == 'p' || mode[0] == 't')
+    printf("Ranks %d..%d: %d .. %d\n", rank_lo, rank_hi,
+           array[rank_lo], array[rank_hi]);
+
+  verify_result(array, records, N, input_sum);
+  free(records);
+  free(scratch);
+  affinity_free(&affinity);
 }
@@ -6,22 +6,68 @@
 //  by the user at runtime and 
 //  sorts the integers using mpi commands. The result is output to a 
 //  file spiceified by the user at runtime.  
-//  Application assumes that N is greater than 10P where P = number of 
-//  processes.
+//  Application requires that N is at least 10P where P = number of 
+//  processes, and exits with a message otherwise.
+//
+//  The splitters between buckets are refined by sampling: every rank
+//  reads a few random blocks of keys from its 1/P share of the file,
+//  rank 0 takes the P-quantiles of all samples so far, and a fresh
+//  sample is counted per bucket and summed with MPI_Allreduce.
+//  Sampling repeats with twice as many keys until the estimated
+//  largest bucket is within <imbalance> of N/P.  When the estimate
+//  says it is not, the real bucket sizes are counted first, and
+//  sampling also stops if they are within <imbalance>, if the largest
+//  bucket is a single key (which occurs more than N/P times), if they
+//  are no better than at the last count, or after MAXROUNDS.  No
+//  assumption is made about the key values; the actual bucket size of
+//  every rank is reported.
+//
+//  Rank 0 streams the input in chunks with nonblocking reads: while
+//  chunk k+1 is being read, chunk k is classified into buckets and
+//  each bucket's part is sent to its owner, so reading, classifying
+//  and the exchange overlap.  The reported time excluding IO leaves
+//  out the time rank 0 actually spent waiting on streamed reads, every
+//  rank's sample and bucket-counting reads while choosing splitters
+//  (both timed as read, not sample/splitter), and the write.
+//
+//  Every rank times the phases read, sample/splitter, classify,
+//  exchange, local sort and write, and counts the bytes it sends and
+//  receives.  Rank 0 prints min/mean/max of each phase across ranks.
+//  For the time spent inside MPI itself, link in the PMPI profiling
+//  layer 03_pmpi_prof.c:
+//   linux> mpicc -o extsort 03_extsort.c 03_pmpi_prof.c
 //
 // Usage: 
 //   linux> mpirun -hostflie <hostfile> -n <#processes> extsort 
-//          [<inputfile> <outputfile>]
+//          [<inputfile> <outputfile> [<chunk> [<imbalance>]]]
+//
+//   <chunk> is the number of ints per read, default CHUNK.
+//   <imbalance> is the allowed excess of a bucket over N/P, default
+//   IMBALANCE (0.1 = 10%).
 // 
 // 
 #define _BSD_SOURCE
 #include <unistd.h>	// for gethostname()
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 #include <mpi.h>
 
 #define TAG 1001
+#define TAG_DONE 1002		// end of a rank's bucket
 #define MINSIZE 10
+#define MINKEYS 10		// keys per process, at least
+#define CHUNK (1 << 20)		// ints per streamed read
+#define OVERSAMPLE 64		// keys per rank in the first sampling round
+#define MAXROUNDS 8		// splitter refinement rounds
+#define IMBALANCE 0.1		// default allowed bucket excess over N/P
+#define SAMPLEBLOCKS 8		// contiguous reads per rank per sample
+
+// phases timed on every rank
+enum { PH_READ, PH_SPLIT, PH_CLASSIFY, PH_EXCHANGE, PH_SORT, PH_WRITE,
+       NPHASE };
+const char *phase_name[NPHASE] = {"read", "sample/splitter", "classify",
+                                  "exchange", "local sort", "write"};
 
 // find min value
 double min(double *array, int length){
@@ -70,20 +116,38 @@ void bubblesort(int *array, int low, int high) {
 	swap(array, i, j);
 }
 
-// Pick an arbitrary element as pivot. Rearrange array 
-// elements into [smaller one, pivot, larger ones].
-// Return pivot's index.
+// Index of the median of array[a], array[b] and array[c]
 //
-int partition(int *array, int low, int high) {
-  int pivot = array[high]; 	// use highest element as pivot 
-  int middle = low;
-  for(int i = low; i < high; i++)
-    if(array[i] < pivot) {
-      swap(array, i, middle);
-      middle++;
-    }
-  swap(array, high, middle);
-  return middle;
+int median3(int *array, int a, int b, int c) {
+  if (array[a] < array[b])
+    return array[b] < array[c] ? b : (array[a] < array[c] ? c : a);
+  return array[a] < array[c] ? a : (array[b] < array[c] ? c : b);
+}
+
+// Pick the pivot as the median of three medians of three (Tukey's
+// ninther) spread over the range, so ordered runs in a bucket (a
+// bucket arrives in stream order) do not make it an extreme. Rearrange
+// array elements into [smaller ones, copies of pivot, larger ones]
+// and return the range of the copies in [*lt, *gt], so runs of equal
+// keys (common in skewed input) are not partitioned again.
+//
+void partition(int *array, int low, int high, int *lt, int *gt) {
+  int mid = low + (high - low) / 2, s = (high - low) / 8;
+  int pivot = array[median3(array,
+                            median3(array, low, low + s, low + 2*s),
+                            median3(array, mid - s, mid, mid + s),
+                            median3(array, high - 2*s, high - s, high))];
+  int i = low;
+  *lt = low;
+  *gt = high;
+  while (i <= *gt) {
+    if (array[i] < pivot)
+      swap(array, (*lt)++, i++);
+    else if (array[i] > pivot)
+      swap(array, i, (*gt)--);
+    else
+      i++;
+  }
 }
  
 // QuickSort an array range
@@ -93,13 +157,214 @@ void quicksort(int *array, int low, int high) {
     bubblesort(array, low, high);
     return;
   }
-  int middle = partition(array, low, high);
-  if (low < middle)
-    quicksort(array, low, middle-1);
-  if (middle < high)
-    quicksort(array, middle+1, high);
+  int lt, gt;
+  partition(array, low, high, &lt, &gt);
+  if (low < lt)
+    quicksort(array, low, lt-1);
+  if (gt < high)
+    quicksort(array, gt+1, high);
 }
  
+// compare ints for qsort()
+int cmp_int(const void *a, const void *b) {
+  int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+// Read s keys from this rank's 1/P share of the input into out, as
+// SAMPLEBLOCKS contiguous blocks at random positions, so a sample
+// costs a few reads rather than one per key.  The time spent reading
+// is added to *io.
+//
+void sample(MPI_File in, int N, int rank, int nprocs, unsigned *seed,
+            int *out, int s, double *io) {
+  long lo = (long) N * rank / nprocs, hi = (long) N * (rank + 1) / nprocs;
+  int b = (s + SAMPLEBLOCKS - 1) / SAMPLEBLOCKS;
+  MPI_Status status;
+
+  for (int done = 0; done < s; ) {
+    int len = (s - done < b) ? s - done : b;
+    if (len > hi - lo)
+      len = hi - lo;
+    long r = (((long) rand_r(seed)) << 31) | rand_r(seed);
+    long pos = lo + r % (hi - lo - len + 1);
+    double t0 = MPI_Wtime();
+    MPI_File_read_at(in, pos * sizeof(int), out + done, len, MPI_INT,
+                     &status);
+    *io += MPI_Wtime() - t0;
+    done += len;
+  }
+}
+
+// Bucket of value v: the first bucket whose pivot is >= v
+//
+int find_bucket(int *pivot, int nprocs, int v) {
+  int lo = 0, hi = nprocs - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (v <= pivot[mid])
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+// Sort chunk[0..len-1] into out by bucket (a counting sort on the
+// bucket number).  Bucket i ends up in out[offs[i]..offs[i+1]-1].
+//
+void classify(int *chunk, int len, int *pivot, int nprocs,
+              int *out, int *offs) {
+  int *pos = (int *)(malloc(sizeof(int) * nprocs));
+
+  for (int i = 0; i <= nprocs; i++)
+    offs[i] = 0;
+  for (int i = 0; i < len; i++)
+    offs[find_bucket(pivot, nprocs, chunk[i]) + 1]++;
+  for (int i = 0; i < nprocs; i++) {
+    offs[i+1] += offs[i];
+    pos[i] = offs[i];
+  }
+  for (int i = 0; i < len; i++)
+    out[pos[find_bucket(pivot, nprocs, chunk[i])]++] = chunk[i];
+
+  free(pos);
+}
+
+// Largest bucket over the mean under the current splitters, counted
+// exactly: every rank streams its 1/P share of the input in chunks and
+// the per-bucket counts are summed with MPI_Allreduce.  *largest is
+// the index of the largest bucket; the time spent reading is added to
+// *io.
+//
+double measure_imbalance(MPI_File in, int N, int rank, int nprocs,
+                         int *pivot, int chunk, int *largest, double *io) {
+  long lo = (long) N * rank / nprocs, hi = (long) N * (rank + 1) / nprocs;
+  long *count = (long *)(calloc(nprocs, sizeof(long)));
+  long *total = (long *)(malloc(sizeof(long) * nprocs));
+  int *buf = (int *)(malloc(sizeof(int) * chunk));
+  MPI_Status status;
+  long big = 0;
+
+  for (long off = lo; off < hi; off += chunk) {
+    int len = (hi - off < chunk) ? hi - off : chunk;
+    double t0 = MPI_Wtime();
+    MPI_File_read_at(in, off * sizeof(int), buf, len, MPI_INT, &status);
+    *io += MPI_Wtime() - t0;
+    for (int i = 0; i < len; i++)
+      count[find_bucket(pivot, nprocs, buf[i])]++;
+  }
+  MPI_Allreduce(count, total, nprocs, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  for (int i = 0; i < nprocs; i++)
+    if (total[i] > big) {
+      big = total[i];
+      *largest = i;
+    }
+
+  free(count);
+  free(total);
+  free(buf);
+  return (double) big * nprocs / N;
+}
+
+// Choose the P-1 splitters (pivot[P-1] = INT_MAX) on every rank by
+// iterative sampling.  Each round every rank reads a fresh sample;
+// after the first round it is counted per bucket under the current
+// splitters and the global histogram is summed with MPI_Allreduce.
+// If the largest bucket is within imbalance of the mean we stop.
+// Otherwise the real bucket sizes are counted (measure_imbalance), as
+// a small sample can be wrong; we also stop if they are within
+// imbalance, if the largest bucket holds a single key (one key occurs
+// more than N/P times, which no splitter can fix), or if they are no
+// better than at the last count (e.g. a splitter falls between two
+// large runs of equal keys, so a larger sample does not help).
+// Otherwise the sample joins the pool on rank 0 and the splitters are
+// recomputed as quantiles of the larger pool; splitters left after
+// MAXROUNDS are counted once more.  Returns the number of times the
+// splitters were computed, *est is the imbalance of the final
+// splitters (largest bucket over the mean), measured if *measured is
+// set and estimated from the sample otherwise.  *io is the time spent
+// reading the file.
+//
+int refine_splitters(MPI_File in, int N, int rank, int nprocs, int chunk,
+                     double imbalance, int *pivot, double *est,
+                     int *measured, double *io) {
+  unsigned seed = 12345u + 7919u * rank;
+  int *hist = (int *)(malloc(sizeof(int) * nprocs));
+  int *total = (int *)(malloc(sizeof(int) * nprocs));
+  int *pool = NULL, *mine = NULL;
+  long npool = 0;
+  double last = 0.0;	// last measured imbalance, 0 if none yet
+  int round, largest;
+
+  *est = 0.0;
+  *measured = 0;
+  *io = 0.0;
+  for (round = 0; round < MAXROUNDS; round++) {
+    int s = OVERSAMPLE << round;
+    mine = (int *)(realloc(mine, sizeof(int) * s));
+    sample(in, N, rank, nprocs, &seed, mine, s, io);
+
+    if (round > 0) {
+      //global histogram of the fresh sample under the current splitters
+      long big = 0;
+      for (int i = 0; i < nprocs; i++)
+        hist[i] = 0;
+      for (int i = 0; i < s; i++)
+        hist[find_bucket(pivot, nprocs, mine[i])]++;
+      MPI_Allreduce(hist, total, nprocs, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+      for (int i = 0; i < nprocs; i++)
+        if (total[i] > big)
+          big = total[i];
+      *est = (double) big / s;	//the mean bucket holds s samples
+      *measured = 0;
+      if (*est <= 1.0 + imbalance)
+        break;
+
+      //check the estimate against the real bucket sizes
+      *est = measure_imbalance(in, N, rank, nprocs, pivot, chunk, &largest,
+                               io);
+      *measured = 1;
+      if (*est <= 1.0 + imbalance || (last > 0.0 && *est >= last) ||
+          (long) pivot[largest] - (largest ? pivot[largest-1] : INT_MIN) == 1)
+        break;
+      last = *est;
+    }
+
+    //add the sample to the pool and take its P-quantiles
+    if (rank == 0)
+      pool = (int *)(realloc(pool, sizeof(int) * (npool + (long) s * nprocs)));
+    MPI_Gather(mine, s, MPI_INT, (rank == 0 ? pool + npool : NULL), s, MPI_INT,
+               0, MPI_COMM_WORLD);
+    if (rank == 0) {
+      npool += (long) s * nprocs;
+      qsort(pool, npool, sizeof(int), cmp_int);
+      for (int i = 0; i < nprocs - 1; i++)
+        pivot[i] = pool[(i + 1) * npool / nprocs - 1];
+      pivot[nprocs - 1] = INT_MAX;
+    }
+    MPI_Bcast(pivot, nprocs, MPI_INT, 0, MPI_COMM_WORLD);
+  }
+  if (round == MAXROUNDS) {
+    *est = measure_imbalance(in, N, rank, nprocs, pivot, chunk, &largest,
+                             io);
+    *measured = 1;
+  }
+
+  free(hist);
+  free(total);
+  free(pool);
+  free(mine);
+  return round;
+}
+
+// Add the time since *t to phase p and restart the clock.
+//
+void lap(double *phase, int p, double *t) {
+  double now = MPI_Wtime();
+  phase[p] += now - *t;
+  *t = now;
+}
 
 int main(int argc, char *argv[])
 {
@@ -107,20 +372,33 @@ int main(int argc, char *argv[])
   char host[50];
   MPI_Status status;
   MPI_Offset filesize;
-  int N, my_count;
+  int N, my_count = 0, cap, chunk = CHUNK, rounds, measured;
+  long offset = 0;
+  double imbalance = IMBALANCE, est, split_io;
   MPI_File in, out;
-  int *array, *pivot, *count, *my_bucket, *bucket_count;
-  int **bucket;
+  int *pivot, *my_bucket, *load = NULL;
+  int *buf[2], *stage[2], *offs;
   double begin, end, end_no_io;
-  double begin_read, end_read, begin_write, end_write;
-  double *time_start, *time_io, *time_no_io;
+  double t, phase[NPHASE] = {0.0};
+  double ph_min[NPHASE], ph_max[NPHASE], ph_sum[NPHASE];
+  long bytes[2] = {0, 0};		// sent, received
+  long *all_bytes = NULL;		// the rest are only allocated on rank 0
+  double *time_start = NULL, *time_io = NULL, *time_no_io = NULL;
 
   //get time including io
   begin = MPI_Wtime();
 //  printf("beg w/ io at %f\n", begin);
 
-  if (argc != 3) {
-    printf("Useage: ./file <input> <output>\n");
+  if (argc < 3 || argc > 5) {
+    printf("Useage: ./file <input> <output> [<chunk> [<imbalance>]]\n");
+    exit(1);
+  }
+  if (argc >= 4 && (chunk = atoi(argv[3])) < 1) {
+    printf("<chunk> must be greater than 0\n");
+    exit(1);
+  }
+  if (argc == 5 && (imbalance = atof(argv[4])) <= 0.0) {
+    printf("<imbalance> must be greater than 0\n");
     exit(1);
   }
 
@@ -138,115 +416,166 @@ int main(int argc, char *argv[])
 
 //  printf("P%d/%d started on %s ...\n", rank, nprocs, host);
 
-  begin_read = MPI_Wtime();
-
-  if (rank == 0) {
+  //everyone samples the input, so everyone opens it
+  MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_RDONLY, MPI_INFO_NULL, &in);
+  MPI_File_get_size(in, &filesize);
+  N = (filesize/sizeof(int));
 
-    //get size of file and number of elements,
-    //read data from input file to array
-    MPI_File_open(MPI_COMM_SELF, argv[1], MPI_MODE_RDONLY, MPI_INFO_NULL, &in);
-    MPI_File_get_size(in, &filesize);
-    N = (filesize/sizeof(int));
-    array = (int *)(malloc(sizeof(int) * N));
-    MPI_File_read(in, array, N, MPI_INT, &status);
+  //every rank samples its own 1/P share, which must not be empty
+  if (N < MINKEYS * nprocs) {
+    if (rank == 0)
+      printf("Need at least %d keys for %d processes, the input has %d\n",
+             MINKEYS * nprocs, nprocs, N);
     MPI_File_close(&in);
+    MPI_Finalize();
+    return(1);
   }
 
-  end_read = MPI_Wtime();
+  //parallel computation starts here
+  //agree on splitters that give every rank about N/P keys
+  pivot = (int *)(malloc(sizeof(int) * nprocs));
+  t = MPI_Wtime();
+  rounds = refine_splitters(in, N, rank, nprocs, chunk, imbalance, pivot,
+                            &est, &measured, &split_io);
+  lap(phase, PH_SPLIT, &t);
+  //its file reads count as read time, so they are left out below
+  phase[PH_SPLIT] -= split_io;
+  phase[PH_READ] += split_io;
+  if (rank == 0)
+    printf("splitters after %d rounds, %s imbalance %.3f\n",
+           rounds, measured ? "measured" : "estimated", est);
+
+  //buckets grow as groups arrive, start at the balanced size
+  cap = N / nprocs + 1;
+  my_bucket = (int *)(malloc(sizeof(int) * cap));
 
-  if (rank == 0) {
+  if (rank == 0){
+    //stream the file: start reading chunk k+1, classify chunk k into
+    //a staging buffer grouped by bucket, send each group to its owner,
+    //then wait for the read.  The staging buffers alternate, so a
+    //buffer's sends only need to finish two chunks later.
+    MPI_Request rreq, *sreq[2];
+    int nsreq[2] = {0, 0};
 
     // set up time array
     time_start = (double *)(malloc(sizeof(double) * nprocs));
     time_io = (double *)(malloc(sizeof(double) * nprocs));
     time_no_io = (double *)(malloc(sizeof(double) * nprocs));
-
-    //sort first 10P elements
-    quicksort(array, 0, (10 * nprocs)-1);
-
-    //store elements at position 10, 20, 30... (10*(P-1)) as pivot vals
-    pivot = (int *)(malloc(sizeof(int) * nprocs));
-    for (int i = 0; i < (nprocs -1); i ++){
-      pivot[i] = array[(i + 1) * 10];
-    }
-    pivot[nprocs - 1] = N;
-
-    //get counts for bucket sizes
-    count = (int *)(malloc(sizeof(int) * nprocs));
-    count[0] = pivot[0];
-    for (int i = 1; i < nprocs; i++){
-      count[i] = pivot[i] - pivot[i-1];
-    }
-
-  }
-
-  //parallel computation starts here
-  //scatter count so everyone knows their bucket size
-  MPI_Scatter(count, 1, MPI_INT, &my_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
-//  printf("node %d/%d got count = %d\n", rank, nprocs, my_count);
-
-  //give each proc their bucket
-  my_bucket = (int *)(malloc(sizeof(int) * my_count));
-
-  if (rank == 0){
-    //put data into appropriate bucket
-    bucket_count = (int *)(malloc(sizeof(int) * nprocs));
-    for (int i = 0; i < nprocs; i++){
-      bucket_count[i] = 0;
-    }
-
-    bucket = (int **)(malloc(sizeof(int *) * nprocs));
-    for (int i = 0; i < nprocs; i++){
-      bucket[i] = (int *)(malloc(sizeof(int) * count[i]));
-    }
-
-    for (int i = 0; i < N; i++){
-      for (int j = 0; j < nprocs; j++){
-        if (array[i] <= pivot[j]){
-          bucket[j][bucket_count[j]] = array[i];
-          bucket_count[j]++;
-          break;
+    load = (int *)(malloc(sizeof(int) * nprocs));
+    all_bytes = (long *)(malloc(sizeof(long) * 2 * nprocs));
+
+    buf[0] = (int *)(malloc(sizeof(int) * chunk));
+    buf[1] = (int *)(malloc(sizeof(int) * chunk));
+    stage[0] = (int *)(malloc(sizeof(int) * chunk));
+    stage[1] = (int *)(malloc(sizeof(int) * chunk));
+    sreq[0] = (MPI_Request *)(malloc(sizeof(MPI_Request) * nprocs));
+    sreq[1] = (MPI_Request *)(malloc(sizeof(MPI_Request) * nprocs));
+    offs = (int *)(malloc(sizeof(int) * (nprocs + 1)));
+
+    t = MPI_Wtime();
+    MPI_File_read_at(in, 0, buf[0], (N < chunk ? N : chunk), MPI_INT, &status);
+    lap(phase, PH_READ, &t);
+
+    for (long off = 0, k = 0; off < N; off += chunk, k++) {
+      int cur = k % 2;
+      int len = (N - off < chunk) ? N - off : chunk;
+      int next = (N - off - len < chunk) ? N - off - len : chunk;
+
+      if (next > 0)
+        MPI_File_iread_at(in, (off + len) * sizeof(int), buf[1 - cur], next,
+                          MPI_INT, &rreq);
+      lap(phase, PH_READ, &t);
+
+      MPI_Waitall(nsreq[cur], sreq[cur], MPI_STATUSES_IGNORE);
+      nsreq[cur] = 0;
+      lap(phase, PH_EXCHANGE, &t);
+
+      classify(buf[cur], len, pivot, nprocs, stage[cur], offs);
+      lap(phase, PH_CLASSIFY, &t);
+      for (int i = 1; i < nprocs; i++) {
+        if (offs[i+1] > offs[i]) {
+          MPI_Isend(stage[cur] + offs[i], offs[i+1] - offs[i], MPI_INT, i,
+                    TAG, MPI_COMM_WORLD, &sreq[cur][nsreq[cur]++]);
+          bytes[0] += sizeof(int) * (offs[i+1] - offs[i]);
         }
       }
-    }
+      lap(phase, PH_EXCHANGE, &t);
 
-    //free array, pivot, bucket_count memory
-    free(array);
-    free(pivot);
-    free(bucket_count);
+      //root keeps its own group
+      if (my_count + offs[1] > cap) {
+        while (my_count + offs[1] > cap)
+          cap *= 2;
+        my_bucket = (int *)(realloc(my_bucket, sizeof(int) * cap));
+      }
+      for (int i = offs[0]; i < offs[1]; i++)
+        my_bucket[my_count++] = stage[cur][i];
+      lap(phase, PH_CLASSIFY, &t);
 
-    //send buckets to other nodes
-    for (int i = 1; i < nprocs; i++){
-      MPI_Send(bucket[i], count[i], MPI_INT, i, TAG, MPI_COMM_WORLD);
+      if (next > 0) {
+        MPI_Wait(&rreq, &status);
+        lap(phase, PH_READ, &t);
+      }
     }
 
-    //note: this is wasteful - could just qsort on bucket[root]
-    //however, decided to linearly move to my_bucket so that
-    //the concurrent code below would encompass root proc.
-    for(int i = 0; i < my_count; i++){
-      my_bucket[i] = bucket[rank][i];
-    }
+    //messages from one sender arrive in order, so an empty message
+    //after the last group tells each rank its bucket is complete
+    for (int i = 1; i < nprocs; i++)
+      MPI_Send(NULL, 0, MPI_INT, i, TAG_DONE, MPI_COMM_WORLD);
 
-    //free bucket and count memory
-    for (int i = 0; i < nprocs; i++){
-      free(bucket[i]);
-    }
+    MPI_Waitall(nsreq[0], sreq[0], MPI_STATUSES_IGNORE);
+    MPI_Waitall(nsreq[1], sreq[1], MPI_STATUSES_IGNORE);
+    lap(phase, PH_EXCHANGE, &t);
 
-    free(bucket);
-    free(count);
+    //free read and staging memory
+    for (int i = 0; i < 2; i++) {
+      free(buf[i]);
+      free(stage[i]);
+      free(sreq[i]);
+    }
+    free(offs);
 
   }
 
   else{
-    //give the other procs their buckets
-    MPI_Recv(my_bucket, my_count, MPI_INT, 0, TAG, MPI_COMM_WORLD, &status);
+    //receive my bucket one group per chunk until the end marker
+    int n;
+    t = MPI_Wtime();
+    for (;;) {
+      MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+      if (status.MPI_TAG == TAG_DONE) {
+        MPI_Recv(NULL, 0, MPI_INT, 0, TAG_DONE, MPI_COMM_WORLD, &status);
+        break;
+      }
+      MPI_Get_count(&status, MPI_INT, &n);
+      if (my_count + n > cap) {
+        while (my_count + n > cap)
+          cap *= 2;
+        my_bucket = (int *)(realloc(my_bucket, sizeof(int) * cap));
+      }
+      MPI_Recv(my_bucket + my_count, n, MPI_INT, 0, TAG, MPI_COMM_WORLD,
+               &status);
+      my_count += n;
+      bytes[1] += sizeof(int) * n;
+    }
+    lap(phase, PH_EXCHANGE, &t);
 //    printf("node %d/%d got a bucket\n", rank, nprocs);
   }
 
+  MPI_File_close(&in);
+  free(pivot);
+
   //parallel computation going forward
   //qsort the bucket
+  t = MPI_Wtime();
   quicksort(my_bucket, 0, my_count-1);
-  begin_write = MPI_Wtime();
+  lap(phase, PH_SORT, &t);
+
+  //my keys follow those of all lower ranks
+  long my_long = my_count;
+  MPI_Exscan(&my_long, &offset, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  if (rank == 0)
+    offset = 0;
+  t = MPI_Wtime();
 
   //write my section to the file
   //open file
@@ -254,26 +583,29 @@ int main(int argc, char *argv[])
                 MPI_INFO_NULL, &out);
 
   //go to the appropriate space in the file
-  MPI_File_set_view(out, ((my_bucket[0] -1) * sizeof(int)), MPI_INT, 
+  MPI_File_set_view(out, offset * sizeof(int), MPI_INT, 
                     MPI_INT, "native", MPI_INFO_NULL);
 
   //write in my section of the file and close file
   MPI_File_write(out, my_bucket, my_count, MPI_INT, &status);
 
   MPI_File_close(&out);
-
-  end_write = MPI_Wtime();
+  lap(phase, PH_WRITE, &t);
 
   //free my_bucket memory
   free(my_bucket);
 
   //get time for each proc taking io into account
   end = MPI_Wtime();
-//  printf("end w/io at %f no io at %f\n", end, end - (end_read - begin_read) -
-//         (end_write - begin_write));
+//  printf("end w/io at %f no io at %f\n", end, end - phase[PH_READ] -
+//         phase[PH_WRITE]);
 
   //organize and deliver time to root
-  end_no_io = end - (end_read - begin_read) - (end_write - begin_write);
+  end_no_io = end - phase[PH_READ] - phase[PH_WRITE];
+
+  MPI_Reduce(phase, ph_min, NPHASE, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+  MPI_Reduce(phase, ph_max, NPHASE, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce(phase, ph_sum, NPHASE, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
 
   MPI_Gather(&end, 1, MPI_DOUBLE, 
              time_io, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
@@ -284,7 +616,28 @@ int main(int argc, char *argv[])
   MPI_Gather(&begin, 1, MPI_DOUBLE, 
              time_start, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
+  MPI_Gather(&my_count, 1, MPI_INT, 
+             load, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+  MPI_Gather(bytes, 2, MPI_LONG, 
+             all_bytes, 2, MPI_LONG, 0, MPI_COMM_WORLD);
+
   if (rank == 0){
+    //load balance: each rank's bucket relative to the mean N/P
+    double mean = (double) N / nprocs, worst = 0.0;
+    for (int i = 0; i < nprocs; i++) {
+      printf("rank %d: %d keys, load %.3f, sent %ld bytes, received %ld bytes\n",
+             i, load[i], load[i] / mean, all_bytes[2*i], all_bytes[2*i+1]);
+      if (load[i] / mean > worst)
+        worst = load[i] / mean;
+    }
+    printf("load imbalance (max/mean): %.3f\n", worst);
+
+    printf("%-16s %10s %10s %10s\n", "phase", "min", "mean", "max");
+    for (int p = 0; p < NPHASE; p++)
+      printf("%-16s %10.6f %10.6f %10.6f\n", phase_name[p], ph_min[p],
+             ph_sum[p] / nprocs, ph_max[p]);
+
     //calculate final timing data for testing
     begin = min(time_start, nprocs);
     end = max(time_io, nprocs);
@@ -297,6 +650,8 @@ int main(int argc, char *argv[])
     free(time_start);
     free(time_io);
     free(time_no_io);
+    free(load);
+    free(all_bytes);
   }
   MPI_Finalize();
 
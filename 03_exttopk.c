@@ -0,0 +1,238 @@
+//  This program finds the k largest integers of a byte file of N
+//  unsorted integers without sorting the file.  Each of the P ranks
+//  streams a 1/P slice of the input in chunks with nonblocking reads
+//  and keeps its k largest keys so far in a buffer of k + chunk ints:
+//  every chunk is appended behind the candidates and a quickselect
+//  built on extsort's three-way partition moves the k largest back to
+//  the front.  The candidates of all ranks (at most kP keys) are
+//  gathered on rank 0, which selects the k largest once more, sorts
+//  them and writes them to the output file in ascending order.
+//
+//  Work per rank is O(N/P) plus O(kP) on rank 0; only the candidates
+//  are communicated, so this is the selection counterpart of extsort
+//  for k much smaller than N/P.
+//
+// Usage:
+//   linux> mpirun -hostflie <hostfile> -n <#processes> exttopk
+//          <inputfile> <outputfile> <k> [<chunk>]
+//
+//   <chunk> is the number of ints per read, default CHUNK.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+#define MINSIZE 10
+#define CHUNK (1 << 20)		// ints per streamed read
+
+// Swap two array elements
+//
+void swap(int *array, int i, int j) {
+  if (i == j) return;
+  int tmp = array[i];
+  array[i] = array[j];
+  array[j] = tmp;
+}
+
+// Bubble sort for the base cases
+//
+void bubblesort(int *array, int low, int high) {
+  if (low >= high)
+    return;
+  for (int i = low; i <= high; i++)
+    for (int j = i+1; j <= high; j++)
+      if (array[i] > array[j])
+	swap(array, i, j);
+}
+
+// Pick the middle element as pivot. Rearrange array elements
+// into [smaller ones, copies of pivot, larger ones] and return
+// the range of the copies in [*lt, *gt].
+//
+void partition(int *array, int low, int high, int *lt, int *gt) {
+  int pivot = array[low + (high - low) / 2];
+  int i = low;
+  *lt = low;
+  *gt = high;
+  while (i <= *gt) {
+    if (array[i] < pivot)
+      swap(array, (*lt)++, i++);
+    else if (array[i] > pivot)
+      swap(array, i, (*gt)--);
+    else
+      i++;
+  }
+}
+
+// QuickSort an array range
+//
+void quicksort(int *array, int low, int high) {
+  if (high - low < MINSIZE) {
+    bubblesort(array, low, high);
+    return;
+  }
+  int lt, gt;
+  partition(array, low, high, &lt, &gt);
+  if (low < lt)
+    quicksort(array, low, lt-1);
+  if (gt < high)
+    quicksort(array, gt+1, high);
+}
+
+// QuickSelect: put the element of rank r (0-based, low <= r <= high)
+// at array[r], smaller ones before it and larger ones after.  Only the
+// side holding r is partitioned again.
+//
+void quickselect(int *array, int low, int high, int r) {
+  while (high - low >= MINSIZE) {
+    int lt, gt;
+    partition(array, low, high, &lt, &gt);
+    if (r < lt)
+      high = lt - 1;
+    else if (r > gt)
+      low = gt + 1;
+    else
+      return;
+  }
+  bubblesort(array, low, high);
+}
+
+// Keep the k largest of array[0..n-1] in array[0..k-1] (unordered).
+// Return the number kept, min(k, n).
+//
+int keep_largest(int *array, int n, int k) {
+  if (n <= k)
+    return n;
+  quickselect(array, 0, n-1, n-k);
+  memmove(array, array + n - k, sizeof(int) * k);
+  return k;
+}
+
+// Stream keys [low, high) of the file and keep the k largest of them
+// in cand[0..k-1], which must hold k + chunk ints.  Return the number
+// kept.
+//
+int scan_topk(MPI_File fh, long low, long high, int k, int chunk, int *cand) {
+  int *buf[2];
+  MPI_Request req;
+  MPI_Status status;
+  int have = 0;
+
+  buf[0] = (int *)(malloc(sizeof(int) * chunk));
+  buf[1] = (int *)(malloc(sizeof(int) * chunk));
+
+  if (low < high)
+    MPI_File_iread_at(fh, low * sizeof(int), buf[0],
+                      (high - low < chunk ? high - low : chunk), MPI_INT, &req);
+
+  for (long off = low, c = 0; off < high; off += chunk, c++) {
+    int cur = c % 2;
+    int len = (high - off < chunk) ? high - off : chunk;
+    int next = (high - off - len < chunk) ? high - off - len : chunk;
+
+    //wait for this chunk, start reading the next one
+    MPI_Wait(&req, &status);
+    if (next > 0)
+      MPI_File_iread_at(fh, (off + len) * sizeof(int), buf[1 - cur], next,
+                        MPI_INT, &req);
+
+    //append behind the candidates and select again
+    memcpy(cand + have, buf[cur], sizeof(int) * len);
+    have = keep_largest(cand, have + len, k);
+  }
+
+  free(buf[0]);
+  free(buf[1]);
+  return have;
+}
+
+int main(int argc, char *argv[])
+{
+  int nprocs, rank, k, chunk = CHUNK;
+  int have, total = 0, *cand, *counts = NULL, *displs = NULL, *all = NULL;
+  MPI_File in, out;
+  MPI_Offset size;
+  long N, low, high;
+  double begin, scan_end;
+
+  if (argc != 4 && argc != 5) {
+    printf("Useage: ./file <input> <output> <k> [<chunk>]\n");
+    exit(1);
+  }
+  if ((k = atoi(argv[3])) < 1) {
+    printf("<k> must be greater than 0\n");
+    exit(1);
+  }
+  if (argc == 5 && (chunk = atoi(argv[4])) < 1) {
+    printf("<chunk> must be greater than 0\n");
+    exit(1);
+  }
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+  begin = MPI_Wtime();
+
+  MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_RDONLY, MPI_INFO_NULL, &in);
+  MPI_File_get_size(in, &size);
+  N = size / sizeof(int);
+
+  if (k > N) {
+    if (rank == 0)
+      printf("<k> = %d is larger than the input (%ld keys)\n", k, N);
+    MPI_File_close(&in);
+    MPI_Finalize();
+    return(1);
+  }
+
+  //my slice, reduced to its k largest keys
+  low = N * rank / nprocs;
+  high = N * (rank + 1) / nprocs;
+  cand = (int *)(malloc(sizeof(int) * ((long) k + chunk)));
+  have = scan_topk(in, low, high, k, chunk, cand);
+  MPI_File_close(&in);
+  scan_end = MPI_Wtime();
+
+  //gather all candidates on rank 0
+  if (rank == 0) {
+    counts = (int *)(malloc(sizeof(int) * nprocs));
+    displs = (int *)(malloc(sizeof(int) * nprocs));
+  }
+  MPI_Gather(&have, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (rank == 0) {
+    total = 0;
+    for (int i = 0; i < nprocs; i++) {
+      displs[i] = total;
+      total += counts[i];
+    }
+    all = (int *)(malloc(sizeof(int) * total));
+  }
+  MPI_Gatherv(cand, have, MPI_INT, all, counts, displs, MPI_INT, 0,
+              MPI_COMM_WORLD);
+
+  MPI_File_open(MPI_COMM_WORLD, argv[2], MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                MPI_INFO_NULL, &out);
+  MPI_File_set_size(out, 0);
+  if (rank == 0) {
+    keep_largest(all, total, k);
+    quicksort(all, 0, k-1);
+    MPI_File_write_at(out, 0, all, k, MPI_INT, MPI_STATUS_IGNORE);
+  }
+  MPI_File_close(&out);
+
+  if (rank == 0) {
+    printf("Top %d of %ld keys: %d .. %d\n", k, N, all[0], all[k-1]);
+    printf("Scan time: %f sec, total time: %f sec (%d candidates, "
+           "%d processes)\n", scan_end - begin, MPI_Wtime() - begin, total,
+           nprocs);
+    free(counts);
+    free(displs);
+    free(all);
+  }
+
+  free(cand);
+  MPI_Finalize();
+  return(0);
+}
@@ -0,0 +1,153 @@
+//  This program verifies the output file of extsort against its input
+//  file in parallel.  Each of the P ranks takes a 1/P slice of both
+//  files and streams it in chunks with nonblocking reads.  For the
+//  output slice it checks that every key is <= the next one, reading
+//  one key past the slice so that the boundary with the next rank is
+//  checked too.  It also computes an order-independent checksum
+//  (checksum.h) of both slices.  The checksums are combined with
+//  MPI_Reduce and must match.  A sorted output that lost, duplicated
+//  or changed keys is therefore caught as well.
+//
+// Usage:
+//   linux> mpirun -hostflie <hostfile> -n <#processes> extverify
+//          <inputfile> <outputfile> [<chunk>]
+//
+//   <chunk> is the number of ints per read, default CHUNK.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <mpi.h>
+#include "checksum.h"
+
+#define CHUNK (1 <<20)		// ints per streamed read
+
+// Stream keys [low, end) of a file and hash those below high into c.
+// If check, return the first index i in [low, end-1) whose key is
+// greater than key i+1, or -1.
+//
+long scan_file(MPI_File fh, long low, long high, long end, int chunk,
+               int check, checksum_t *c) {
+  int *buf[2];
+  MPI_Request req;
+  MPI_Status status;
+  long bad = -1;
+  int prev = 0;
+
+  buf[0] = (int *)(malloc(sizeof(int) * chunk));
+  buf[1] = (int *)(malloc(sizeof(int) * chunk));
+  checksum_init(c);
+
+  if (low < end)
+    MPI_File_iread_at(fh, low * sizeof(int), buf[0],
+                      (end - low < chunk ? end - low : chunk), MPI_INT, &req);
+
+  for (long off = low, k = 0; off < end; off += chunk, k++) {
+    int cur = k % 2;
+    int len = (end - off < chunk) ? end - off : chunk;
+    int next = (end - off - len < chunk) ? end - off - len : chunk;
+
+    //wait for this chunk, start reading the next one
+    MPI_Wait(&req, &status);
+    if (next > 0)
+      MPI_File_iread_at(fh, (off + len) * sizeof(int), buf[1 - cur], next,
+                        MPI_INT, &req);
+
+    for (int j = 0; j < len; j++) {
+      long i = off + j;
+      if (i < high)
+        checksum_add(c, (uint32_t) buf[cur][j]);
+      if (check && i > low && bad < 0 && prev > buf[cur][j])
+        bad = i - 1;
+      prev = buf[cur][j];
+    }
+  }
+
+  free(buf[0]);
+  free(buf[1]);
+  return bad;
+}
+
+int main(int argc, char *argv[])
+{
+  int nprocs, rank, chunk = CHUNK;
+  MPI_File in, out;
+  MPI_Offset in_size, out_size;
+  checksum_t in_sum, out_sum, total[2];
+  long N, low, high, bad, first;
+  double begin;
+
+  if (argc != 3 && argc != 4) {
+    printf("Useage: ./file <input> <output> [<chunk>]\n");
+    exit(1);
+  }
+  if (argc == 4 && (chunk = atoi(argv[3])) < 1) {
+    printf("<chunk> must be greater than 0\n");
+    exit(1);
+  }
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+  begin = MPI_Wtime();
+
+  MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_RDONLY, MPI_INFO_NULL, &in);
+  MPI_File_open(MPI_COMM_WORLD, argv[2], MPI_MODE_RDONLY, MPI_INFO_NULL, &out);
+  MPI_File_get_size(in, &in_size);
+  MPI_File_get_size(out, &out_size);
+
+  if (in_size != out_size) {
+    if (rank == 0)
+      printf("FAILED: input has %lld bytes, output %lld\n",
+             (long long) in_size, (long long) out_size);
+    MPI_File_close(&in);
+    MPI_File_close(&out);
+    MPI_Finalize();
+    return(1);
+  }
+
+  //my slice; the order check reads one key into the next slice
+  N = in_size / sizeof(int);
+  low = N * rank / nprocs;
+  high = N * (rank + 1) / nprocs;
+
+  scan_file(in, low, high, high, chunk, 0, &in_sum);
+  bad = scan_file(out, low, high, (high < N ? high + 1 : high), chunk, 1,
+                  &out_sum);
+  if (bad < 0)
+    bad = LONG_MAX;
+
+  //combine: sum and xor of the hashes, first bad index
+  MPI_Reduce(&in_sum.sum, &total[0].sum, 1, MPI_UINT64_T, MPI_SUM, 0,
+             MPI_COMM_WORLD);
+  MPI_Reduce(&in_sum.xr, &total[0].xr, 1, MPI_UINT64_T, MPI_BXOR, 0,
+             MPI_COMM_WORLD);
+  MPI_Reduce(&out_sum.sum, &total[1].sum, 1, MPI_UINT64_T, MPI_SUM, 0,
+             MPI_COMM_WORLD);
+  MPI_Reduce(&out_sum.xr, &total[1].xr, 1, MPI_UINT64_T, MPI_BXOR, 0,
+             MPI_COMM_WORLD);
+  MPI_Reduce(&bad, &first, 1, MPI_LONG, MPI_MIN, 0, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    printf("Verify time: %f sec (%ld keys, %d processes)\n",
+           MPI_Wtime() - begin, N, nprocs);
+    if (first != LONG_MAX) {
+      int pair[2];
+      MPI_File_read_at(out, first * sizeof(int), pair, 2, MPI_INT,
+                       MPI_STATUS_IGNORE);
+      printf("FAILED: out[%ld] = %d, out[%ld] = %d\n",
+             first, pair[0], first + 1, pair[1]);
+    }
+    else if (!checksum_equal(&total[0], &total[1]))
+      printf("FAILED: checksum of the output does not match the input\n");
+    else
+      printf("Result verified!\n");
+  }
+
+  MPI_File_close(&in);
+  MPI_File_close(&out);
+  MPI_Finalize();
+  return(0);
+}
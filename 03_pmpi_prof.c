@@ -0,0 +1,549 @@
+//  PMPI profiling layer for the MPI programs.  Linking this file in
+//  front of the MPI library intercepts the calls below, times them and
+//  counts the bytes moved; the real work is done by the PMPI_ entry
+//  points.  Every call the programs in this directory make that
+//  communicates, synchronizes or touches a file is intercepted, and
+//  its time is split into three classes:
+//    p2p         point-to-point sends, receives, probes, persistent
+//                requests and waits
+//    collective  barriers, broadcasts, reductions, gathers, scans and
+//                communicator/topology creation and release
+//    io          MPI-IO opens, reads, writes, size/view changes, syncs
+//                and waits on file requests
+//  Everything else between MPI_Init and MPI_Finalize counts as compute,
+//  including the purely local calls left alone here (rank and size
+//  queries, Cart_coords, Cart_shift, Dims_create, datatype
+//  construction, Get_count and Wtime).
+//
+//  At MPI_Finalize rank 0 prints min/mean/max of each class across
+//  ranks and names the class with the largest mean, which tells
+//  whether a run was CPU, network or I/O bound.
+//
+//  Nonblocking file requests and receives are remembered (up to
+//  MAXPENDING at a time) until MPI_Wait or MPI_Waitall completes them:
+//  waits on file requests count as io, and a receive's bytes are
+//  counted from its status then.  Persistent requests are remembered
+//  from MPI_Send_init/MPI_Recv_init until MPI_Request_free: every
+//  MPI_Start of a send counts its bytes, and every start of a receive
+//  makes it pending like an MPI_Irecv.  Requests completed with
+//  MPI_Test* (which no program here uses) are not tracked, so their
+//  bytes are missing; if more than MAXPENDING requests of either kind
+//  are outstanding, a warning is printed once and the excess counts as
+//  p2p without bytes.  Sends to MPI_PROC_NULL move no bytes and are
+//  not counted.
+//
+// Usage:
+//   linux> mpicc -o extsort 03_extsort.c 03_pmpi_prof.c
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#define MAXPENDING 64	// outstanding nonblocking requests tracked
+
+enum { C_P2P, C_COLL, C_IO, C_COMPUTE, NCLASS };
+static const char *class_name[NCLASS] = {"p2p", "collective", "io", "compute"};
+
+static double prof_time[NCLASS];
+static long prof_calls[NCLASS];
+static long prof_sent, prof_recv;	// p2p payload bytes
+static double prof_start;
+
+// nonblocking requests not completed yet: file requests (type
+// MPI_DATATYPE_NULL), so their waits count as io, and receives of
+// <type>, whose bytes are counted when they complete
+static struct {
+  MPI_Request req;
+  MPI_Datatype type;
+} pending[MAXPENDING];
+static int npending, overflowed;
+
+// persistent requests: <bytes> sent per start, or received into <type>
+static struct {
+  MPI_Request req;
+  MPI_Datatype type;	// MPI_DATATYPE_NULL for a send
+  long bytes;
+} persistent[MAXPENDING];
+static int npersistent;
+
+static void account(int c, double t0) {
+  prof_time[c] += PMPI_Wtime() - t0;
+  prof_calls[c]++;
+}
+
+static long type_bytes(int count, MPI_Datatype type) {
+  int size;
+  PMPI_Type_size(type, &size);
+  return (long) count * size;
+}
+
+// payload bytes of a completed receive of <type>
+static long status_bytes(MPI_Status *status, MPI_Datatype type) {
+  int n;
+  PMPI_Get_count(status, type, &n);
+  return n == MPI_UNDEFINED ? 0 : type_bytes(n, type);
+}
+
+// warn once that a request table is full
+static void overflow(void) {
+  if (!overflowed) {
+    int rank;
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    fprintf(stderr, "pmpi: rank %d has more than %d pending requests; "
+            "the rest count as p2p and their bytes are not counted\n",
+            rank, MAXPENDING);
+    overflowed = 1;
+  }
+}
+
+// remember req until a wait completes it
+static void add_pending(MPI_Request req, MPI_Datatype type) {
+  if (npending < MAXPENDING) {
+    pending[npending].req = req;
+    pending[npending].type = type;
+    npending++;
+  } else
+    overflow();
+}
+
+// remember a persistent request until it is freed
+static void add_persistent(MPI_Request req, MPI_Datatype type, long bytes) {
+  if (npersistent < MAXPENDING) {
+    persistent[npersistent].req = req;
+    persistent[npersistent].type = type;
+    persistent[npersistent].bytes = bytes;
+    npersistent++;
+  } else
+    overflow();
+}
+
+// account for starting req if it is a known persistent request
+static void start_persistent(MPI_Request req) {
+  for (int i = 0; i < npersistent; i++) {
+    if (persistent[i].req == req) {
+      if (persistent[i].type == MPI_DATATYPE_NULL)
+        prof_sent += persistent[i].bytes;
+      else
+        add_pending(req, persistent[i].type);
+      return;
+    }
+  }
+}
+
+// is req pending?  forget it and return its type in *type if so
+static int take_pending(MPI_Request req, MPI_Datatype *type) {
+  for (int i = 0; i < npending; i++) {
+    if (pending[i].req == req) {
+      *type = pending[i].type;
+      pending[i] = pending[--npending];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int MPI_Init(int *argc, char ***argv) {
+  int rc = PMPI_Init(argc, argv);
+  prof_start = PMPI_Wtime();
+  return rc;
+}
+
+// point to point
+
+int MPI_Send(const void *buf, int count, MPI_Datatype type, int dest,
+             int tag, MPI_Comm comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Send(buf, count, type, dest, tag, comm);
+  if (dest != MPI_PROC_NULL)
+    prof_sent += type_bytes(count, type);
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype type, int dest,
+              int tag, MPI_Comm comm, MPI_Request *req) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Isend(buf, count, type, dest, tag, comm, req);
+  if (dest != MPI_PROC_NULL)
+    prof_sent += type_bytes(count, type);
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype type, int source, int tag,
+             MPI_Comm comm, MPI_Status *status) {
+  MPI_Status st;
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Recv(buf, count, type, source, tag, comm, &st);
+  prof_recv += status_bytes(&st, type);
+  if (status != MPI_STATUS_IGNORE)
+    *status = st;
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype type, int source, int tag,
+              MPI_Comm comm, MPI_Request *req) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Irecv(buf, count, type, source, tag, comm, req);
+  add_pending(*req, type);
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Sendrecv(const void *sbuf, int scount, MPI_Datatype stype, int dest,
+                 int stag, void *rbuf, int rcount, MPI_Datatype rtype,
+                 int source, int rtag, MPI_Comm comm, MPI_Status *status) {
+  MPI_Status st;
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Sendrecv(sbuf, scount, stype, dest, stag, rbuf, rcount,
+                         rtype, source, rtag, comm, &st);
+  if (dest != MPI_PROC_NULL)
+    prof_sent += type_bytes(scount, stype);
+  prof_recv += status_bytes(&st, rtype);
+  if (status != MPI_STATUS_IGNORE)
+    *status = st;
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status *status) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Probe(source, tag, comm, status);
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Send_init(const void *buf, int count, MPI_Datatype type, int dest,
+                  int tag, MPI_Comm comm, MPI_Request *req) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Send_init(buf, count, type, dest, tag, comm, req);
+  add_persistent(*req, MPI_DATATYPE_NULL,
+                 dest != MPI_PROC_NULL ? type_bytes(count, type) : 0);
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Recv_init(void *buf, int count, MPI_Datatype type, int source,
+                  int tag, MPI_Comm comm, MPI_Request *req) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Recv_init(buf, count, type, source, tag, comm, req);
+  add_persistent(*req, type, 0);
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Start(MPI_Request *req) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Start(req);
+  start_persistent(*req);
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Startall(int count, MPI_Request reqs[]) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Startall(count, reqs);
+  for (int i = 0; i < count; i++)
+    start_persistent(reqs[i]);
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Request_free(MPI_Request *req) {
+  MPI_Datatype type;
+  for (int i = 0; i < npersistent; i++) {
+    if (persistent[i].req == *req) {
+      persistent[i] = persistent[--npersistent];
+      break;
+    }
+  }
+  take_pending(*req, &type);
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Request_free(req);
+  account(C_P2P, t0);
+  return rc;
+}
+
+int MPI_Wait(MPI_Request *req, MPI_Status *status) {
+  MPI_Datatype type = MPI_DATATYPE_NULL;
+  MPI_Status st;
+  int tracked = take_pending(*req, &type);
+  int c = (tracked && type == MPI_DATATYPE_NULL) ? C_IO : C_P2P;
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Wait(req, &st);
+  if (c == C_P2P && tracked)
+    prof_recv += status_bytes(&st, type);
+  if (status != MPI_STATUS_IGNORE)
+    *status = st;
+  account(c, t0);
+  return rc;
+}
+
+int MPI_Waitall(int count, MPI_Request reqs[], MPI_Status statuses[]) {
+  MPI_Datatype type[count > 0 ? count : 1];	// receive type, or NULL
+  MPI_Status *st = statuses;
+  int c = C_P2P, nrecv = 0;
+  for (int i = 0; i < count; i++) {
+    type[i] = MPI_DATATYPE_NULL;
+    if (take_pending(reqs[i], &type[i])) {
+      if (type[i] == MPI_DATATYPE_NULL)
+        c = C_IO;
+      else
+        nrecv++;
+    }
+  }
+  if (nrecv && statuses == MPI_STATUSES_IGNORE)
+    st = (MPI_Status *)(malloc(sizeof(MPI_Status) * count));
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Waitall(count, reqs, st);
+  for (int i = 0; nrecv && i < count; i++)
+    if (type[i] != MPI_DATATYPE_NULL)
+      prof_recv += status_bytes(&st[i], type[i]);
+  if (st != statuses)
+    free(st);
+  account(c, t0);
+  return rc;
+}
+
+// collectives
+
+int MPI_Barrier(MPI_Comm comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Barrier(comm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Bcast(void *buf, int count, MPI_Datatype type, int root,
+              MPI_Comm comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Bcast(buf, count, type, root, comm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Reduce(const void *sbuf, void *rbuf, int count, MPI_Datatype type,
+               MPI_Op op, int root, MPI_Comm comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Reduce(sbuf, rbuf, count, type, op, root, comm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Allreduce(const void *sbuf, void *rbuf, int count, MPI_Datatype type,
+                  MPI_Op op, MPI_Comm comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Allreduce(sbuf, rbuf, count, type, op, comm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Exscan(const void *sbuf, void *rbuf, int count, MPI_Datatype type,
+               MPI_Op op, MPI_Comm comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Exscan(sbuf, rbuf, count, type, op, comm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Gather(const void *sbuf, int scount, MPI_Datatype stype, void *rbuf,
+               int rcount, MPI_Datatype rtype, int root, MPI_Comm comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Gather(sbuf, scount, stype, rbuf, rcount, rtype, root, comm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Scatter(const void *sbuf, int scount, MPI_Datatype stype, void *rbuf,
+                int rcount, MPI_Datatype rtype, int root, MPI_Comm comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Scatter(sbuf, scount, stype, rbuf, rcount, rtype, root, comm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Gatherv(const void *sbuf, int scount, MPI_Datatype stype, void *rbuf,
+                const int rcounts[], const int displs[], MPI_Datatype rtype,
+                int root, MPI_Comm comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Gatherv(sbuf, scount, stype, rbuf, rcounts, displs, rtype,
+                        root, comm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Cart_create(MPI_Comm comm, int ndims, const int dims[],
+                    const int periods[], int reorder, MPI_Comm *cart) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Cart_create(comm, ndims, dims, periods, reorder, cart);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm *newcomm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Comm_split(comm, color, key, newcomm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+int MPI_Comm_free(MPI_Comm *comm) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_Comm_free(comm);
+  account(C_COLL, t0);
+  return rc;
+}
+
+// MPI-IO
+
+int MPI_File_open(MPI_Comm comm, const char *name, int amode, MPI_Info info,
+                  MPI_File *fh) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_open(comm, name, amode, info, fh);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_close(MPI_File *fh) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_close(fh);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_get_size(MPI_File fh, MPI_Offset *size) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_get_size(fh, size);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_set_size(MPI_File fh, MPI_Offset size) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_set_size(fh, size);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_set_view(MPI_File fh, MPI_Offset disp, MPI_Datatype etype,
+                      MPI_Datatype filetype, const char *datarep,
+                      MPI_Info info) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_set_view(fh, disp, etype, filetype, datarep, info);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_sync(MPI_File fh) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_sync(fh);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_read_all(MPI_File fh, void *buf, int count, MPI_Datatype type,
+                      MPI_Status *status) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_read_all(fh, buf, count, type, status);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset off, void *buf, int count,
+                         MPI_Datatype type, MPI_Status *status) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_read_at_all(fh, off, buf, count, type, status);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_read_at(MPI_File fh, MPI_Offset off, void *buf, int count,
+                     MPI_Datatype type, MPI_Status *status) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_read_at(fh, off, buf, count, type, status);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_iread_at(MPI_File fh, MPI_Offset off, void *buf, int count,
+                      MPI_Datatype type, MPI_Request *req) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_iread_at(fh, off, buf, count, type, req);
+  add_pending(*req, MPI_DATATYPE_NULL);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_write(MPI_File fh, const void *buf, int count,
+                   MPI_Datatype type, MPI_Status *status) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_write(fh, buf, count, type, status);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_write_at(MPI_File fh, MPI_Offset off, const void *buf,
+                      int count, MPI_Datatype type, MPI_Status *status) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_write_at(fh, off, buf, count, type, status);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset off, const void *buf,
+                          int count, MPI_Datatype type, MPI_Status *status) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_write_at_all(fh, off, buf, count, type, status);
+  account(C_IO, t0);
+  return rc;
+}
+
+int MPI_File_iwrite_all(MPI_File fh, const void *buf, int count,
+                        MPI_Datatype type, MPI_Request *req) {
+  double t0 = PMPI_Wtime();
+  int rc = PMPI_File_iwrite_all(fh, buf, count, type, req);
+  add_pending(*req, MPI_DATATYPE_NULL);
+  account(C_IO, t0);
+  return rc;
+}
+
+// Report across ranks, then shut down.
+//
+int MPI_Finalize(void) {
+  int rank, nprocs, bound = 0;
+  double lo[NCLASS], hi[NCLASS], sum[NCLASS];
+  long bytes[2] = {prof_sent, prof_recv}, blo[2], bhi[2], bsum[2];
+
+  PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  PMPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+  prof_time[C_COMPUTE] = PMPI_Wtime() - prof_start
+                         - prof_time[C_P2P] - prof_time[C_COLL] - prof_time[C_IO];
+
+  PMPI_Reduce(prof_time, lo, NCLASS, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+  PMPI_Reduce(prof_time, hi, NCLASS, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  PMPI_Reduce(prof_time, sum, NCLASS, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  PMPI_Reduce(bytes, blo, 2, MPI_LONG, MPI_MIN, 0, MPI_COMM_WORLD);
+  PMPI_Reduce(bytes, bhi, 2, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+  PMPI_Reduce(bytes, bsum, 2, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    printf("pmpi: %-10s %10s %10s %10s %11s\n", "class", "min", "mean", "max",
+           "calls on 0");
+    for (int c = 0; c < NCLASS; c++) {
+      printf("pmpi: %-10s %10.6f %10.6f %10.6f %11ld\n", class_name[c], lo[c],
+             sum[c] / nprocs, hi[c], prof_calls[c]);
+      if (sum[c] > sum[bound])
+        bound = c;
+    }
+    printf("pmpi: bytes sent min %ld mean %ld max %ld\n", blo[0],
+           bsum[0] / nprocs, bhi[0]);
+    printf("pmpi: bytes received min %ld mean %ld max %ld\n", blo[1],
+           bsum[1] / nprocs, bhi[1]);
+    printf("pmpi: mostly %s bound\n",
+           bound == C_COMPUTE ? "cpu" : bound == C_IO ? "io" : "network");
+  }
+
+  return PMPI_Finalize();
+}
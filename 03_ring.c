@@ -1,37 +1,127 @@
-//------------------------------------------------------------------------- 
+//-------------------------------------------------------------------------
 // This is supporting software for CS415/515 Parallel Programming.
 // Copyright (c) Portland State University
 // MPI assignment: Thomas Van Klaveren
-//------------------------------------------------------------------------- 
+//-------------------------------------------------------------------------
 
-// A simple demo program of MPI send-receive routines.
+// MPI point-to-point latency/bandwidth benchmark.
+//
+// - Process 0 and a peer process bounce a message back and forth.
+// - Message sizes go from 1 byte up to <max_bytes> (default 64 MB),
+//   doubling each time.
+// - Each size is measured with blocking MPI_Send/MPI_Recv, MPI_Sendrecv,
+//   nonblocking MPI_Isend/MPI_Irecv and persistent requests, after a
+//   few warm-up round trips.
+// - Every round trip is timed on its own; process 0 reports the
+//   mean and min/p50/p90/p99 round-trip time and the bandwidth (bytes
+//   moved in both directions over the mean round-trip time).
+//
+// With MPI_Sendrecv both sides send at the same time, so that mode
+// measures a bidirectional exchange rather than a strict ping-pong.
+// Back-to-back exchanges overlap (a side usually finds the other's
+// next message already there), so a single exchange cannot be timed:
+// the whole batch is timed and only the mean time per exchange and
+// the bandwidth are reported, with no percentiles.
+// Other processes stay idle; pick a peer on another node to measure
+// the network rather than shared memory.
+//
+// Usage:
+//   linux> mpirun -hostflie <hostfile> -n <#processes> ring
+//          [<max_bytes> [<iters> [<peer>]]]
 //
-// - Process 0 sends an integer to process 1.
-// - Process N decreases the integer's value by one, and sends it back
 //
-// Usage: 
-//   linux> mpirun -hostflie <hostfile> -n <#processes> simple [<N>]
-// 
-// 
 #define _BSD_SOURCE
 #include <unistd.h>	// for gethostname()
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <mpi.h>
 
 #define TAG 1001
+#define MAXBYTES (64 << 20)	// default largest message
+#define ITERS 1000		// default round trips per size
+#define MINITERS 10		// fewest round trips for large messages
+#define BIGMSG (64 << 10)	// sizes above this get fewer iterations
+
+// Transfer modes
+//
+enum { BLOCKING, SENDRECV, NONBLOCKING, PERSISTENT, NMODES };
+const char *mode_name[NMODES] =
+  {"send/recv", "sendrecv", "isend/irecv", "persistent"};
 
+// compare doubles for qsort()
+int cmp_double(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+// One round trip between process 0 (the initiator) and the peer.
+// preq holds the persistent receive and send requests for this size.
+//
+void round_trip(int mode, int initiator, int other, MPI_Comm comm,
+                char *sbuf, char *rbuf, int size, MPI_Request preq[2]) {
+  MPI_Request req[2];
+
+  switch (mode) {
+  case BLOCKING:
+    if (initiator) {
+      MPI_Send(sbuf, size, MPI_BYTE, other, TAG, comm);
+      MPI_Recv(rbuf, size, MPI_BYTE, other, TAG, comm, MPI_STATUS_IGNORE);
+    }
+    else {
+      MPI_Recv(rbuf, size, MPI_BYTE, other, TAG, comm, MPI_STATUS_IGNORE);
+      MPI_Send(sbuf, size, MPI_BYTE, other, TAG, comm);
+    }
+    break;
+
+  case SENDRECV:
+    MPI_Sendrecv(sbuf, size, MPI_BYTE, other, TAG,
+                 rbuf, size, MPI_BYTE, other, TAG, comm, MPI_STATUS_IGNORE);
+    break;
+
+  case NONBLOCKING:
+    MPI_Irecv(rbuf, size, MPI_BYTE, other, TAG, comm, &req[0]);
+    if (initiator) {
+      MPI_Isend(sbuf, size, MPI_BYTE, other, TAG, comm, &req[1]);
+      MPI_Waitall(2, req, MPI_STATUSES_IGNORE);
+    }
+    else {
+      MPI_Wait(&req[0], MPI_STATUS_IGNORE);
+      MPI_Isend(sbuf, size, MPI_BYTE, other, TAG, comm, &req[1]);
+      MPI_Wait(&req[1], MPI_STATUS_IGNORE);
+    }
+    break;
+
+  case PERSISTENT:
+    if (initiator) {
+      MPI_Startall(2, preq);
+      MPI_Waitall(2, preq, MPI_STATUSES_IGNORE);
+    }
+    else {
+      MPI_Start(&preq[0]);
+      MPI_Wait(&preq[0], MPI_STATUS_IGNORE);
+      MPI_Start(&preq[1]);
+      MPI_Wait(&preq[1], MPI_STATUS_IGNORE);
+    }
+    break;
+  }
+}
 
 int main(int argc, char *argv[])
 {
   int nprocs, rank;
   char host[50];
-  MPI_Status status;
-  int N = 10;		// default integer value
-  
-  if (argc == 2) {
-    N = atoi(argv[1]);	// overwirte the value
-  }
+  long max_bytes = MAXBYTES;	// largest message size
+  int iters = ITERS;		// round trips per size
+  int peer = 1;			// process paired with process 0
+  MPI_Comm pair;
+
+  if (argc > 1)
+    max_bytes = atol(argv[1]);
+  if (argc > 2)
+    iters = atoi(argv[2]);
+  if (argc > 3)
+    peer = atoi(argv[3]);
   gethostname(host, 50);
 
   MPI_Init(&argc, &argv);
@@ -42,27 +132,101 @@ int main(int argc, char *argv[])
     MPI_Finalize();
     return(1);
   }
+  if (peer < 1 || peer >= nprocs || max_bytes < 1 || max_bytes > (1L << 30)
+      || iters < 1) {
+    if (rank == 0)
+      printf("Usage: ring [<max_bytes> [<iters> [<peer>]]], "
+             "1 <= peer < %d, max_bytes <= 1 GB\n", nprocs);
+    MPI_Finalize();
+    return(1);
+  }
+
+  // only process 0 and the peer take part
+  MPI_Comm_split(MPI_COMM_WORLD, (rank == 0 || rank == peer) ? 0 :
+                 MPI_UNDEFINED, rank, &pair);
+  if (pair == MPI_COMM_NULL) {
+    MPI_Finalize();
+    return 0;
+  }
+
   printf("P%d/%d started on %s ...\n", rank, nprocs, host);
 
-  if (rank == 0) {
-    MPI_Send(&N, 1, MPI_INT, rank+1, TAG, MPI_COMM_WORLD);
-    printf("P0 sent %d to P1\n", N);
-    MPI_Recv(&N, 1, MPI_INT, nprocs-1, TAG, MPI_COMM_WORLD, &status);
-    printf("P0 recieved %d\n", N);
-  } 
-  else {
-    MPI_Recv(&N, 1, MPI_INT, rank-1, TAG, MPI_COMM_WORLD, &status);
-    printf("P%d recieved %d\n", rank, N);
-    N--;
-    if (rank < nprocs-1){
-      MPI_Send(&N, 1, MPI_INT, rank+1, TAG, MPI_COMM_WORLD);
-      printf("P%d sent %d to P%d\n", rank, N, rank+1);
+  int initiator = (rank == 0);
+  int other = initiator ? 1 : 0;	// rank within the pair
+  char *sbuf = (char *) malloc(max_bytes);
+  char *rbuf = (char *) malloc(max_bytes);
+  double *times = (double *) malloc(sizeof(double) * (iters > MINITERS ?
+                                                      iters : MINITERS));
+  memset(sbuf, rank, max_bytes);
+  memset(rbuf, 0, max_bytes);
+
+  MPI_Barrier(pair);
+  if (initiator) {
+    printf("%-12s %10s %7s %10s %10s %10s %10s %10s %10s\n", "mode",
+           "bytes", "iters", "mean(us)", "min(us)", "p50(us)", "p90(us)",
+           "p99(us)", "MB/s");
+  }
+
+  for (int mode = 0; mode < NMODES; mode++) {
+    for (long size = 1; size <= max_bytes; size *= 2) {
+      int n = iters;
+      if (size > BIGMSG) {
+        n = (int) (iters * (double) BIGMSG / size);
+        if (n < MINITERS)
+          n = MINITERS;
+      }
+      int warmup = n / 10 < 2 ? 2 : n / 10;
+      MPI_Request preq[2];
+
+      if (mode == PERSISTENT) {
+        MPI_Recv_init(rbuf, size, MPI_BYTE, other, TAG, pair, &preq[0]);
+        MPI_Send_init(sbuf, size, MPI_BYTE, other, TAG, pair, &preq[1]);
+      }
+
+      for (int i = 0; i < warmup; i++)
+        round_trip(mode, initiator, other, pair, sbuf, rbuf, size, preq);
+      MPI_Barrier(pair);
+
+      double sum = 0.0;
+      if (mode == SENDRECV) {
+        // exchanges pipeline, so only the batch is timed
+        double t = MPI_Wtime();
+        for (int i = 0; i < n; i++)
+          round_trip(mode, initiator, other, pair, sbuf, rbuf, size, preq);
+        sum = MPI_Wtime() - t;
+      }
+      else {
+        for (int i = 0; i < n; i++) {
+          double t = MPI_Wtime();
+          round_trip(mode, initiator, other, pair, sbuf, rbuf, size, preq);
+          times[i] = MPI_Wtime() - t;
+          sum += times[i];
+        }
+      }
+
+      if (mode == PERSISTENT) {
+        MPI_Request_free(&preq[0]);
+        MPI_Request_free(&preq[1]);
+      }
+
+      if (initiator && mode == SENDRECV) {
+        printf("%-12s %10ld %7d %10.2f %10s %10s %10s %10s %10.2f\n",
+               mode_name[mode], size, n, sum / n * 1e6, "-", "-", "-", "-",
+               2.0 * size / (sum / n) / 1e6);
+      }
+      else if (initiator) {
+        qsort(times, n, sizeof(double), cmp_double);
+        printf("%-12s %10ld %7d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+               mode_name[mode], size, n, sum / n * 1e6, times[0] * 1e6,
+               times[(n-1) * 50 / 100] * 1e6, times[(n-1) * 90 / 100] * 1e6,
+               times[(n-1) * 99 / 100] * 1e6, 2.0 * size / (sum / n) / 1e6);
+      }
     }
-    else{
-      MPI_Send(&N, 1, MPI_INT, 0, TAG, MPI_COMM_WORLD);
-      printf("P%d sent %d to P0\n", rank, N);
-    } 
   }
 
+  free(times);
+  free(sbuf);
+  free(rbuf);
+  MPI_Comm_free(&pair);
   MPI_Finalize();
 }
@@ -9,9 +9,10 @@
 // 
 //
 
-use BlockDist, CyclicDist;
+use BlockDist, CyclicDist, BlockCycDist;
 
 config const n = 8;
+config const blockSize = 2;
 const D = {1..n, 1..n};
 const D2 = D.expand(-1, -1);
 
@@ -27,6 +28,15 @@ var BA: [D] int = 0;
 const CyclicD = D2 dmapped Cyclic(startIdx=D.low);
 var CA: [D] int = 0;
 
+// A 2D BlockCyclic-distributed domain BlockCycD, dealing out
+// blockSize x blockSize blocks round-robin, and an array over it.
+// (A Stencil distribution owns the same elements as Block; it only
+// adds cached copies of its neighbours' edges.)
+//
+const BlockCycD = D2 dmapped BlockCyclic(startIdx=D2.low,
+                                          blocksize=(blockSize, blockSize));
+var BCA: [D] int = 0;
+
 // To illustrate how the index set is distributed across locales,
 // we'll use forall loop to initialize each array element to the
 // locale ID that stores that element.
@@ -40,6 +50,9 @@ forall e in BlockD do {
 forall e in CyclicD do
   CA(e) = here.id;
 
+forall e in BlockCycD do
+  BCA(e) = here.id;
+
 
 // Output the arrays to visually see how the elements are
 // partitioned across the locales.
@@ -49,3 +62,6 @@ writeln(BA);
 
 writeln("Cyclic Array:");
 writeln(CA);
+
+writeln("BlockCyclic Array:");
+writeln(BCA);
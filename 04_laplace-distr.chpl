@@ -5,235 +5,416 @@
 
 // Jacobi method for solving a Laplace equation.  
 //
-// Usage: ./jacobi-shm -nl <#locales>
+// The distribution of the mesh arrays is chosen with --dist:
+//   stencil      Block with one layer of cached ghost cells around each
+//                locale's block (default), so every stencil read is
+//                local; the ghost cells are refreshed with
+//                updateFluff() once per Jacobi sweep, per red/black
+//                color and per Gauss-Seidel wavefront phase
+//   block        plain Block; reads across a block edge are remote
+//   cyclic       Cyclic; almost every neighbour is on another locale
+//   blockCyclic  BlockCyclic with --blockSize x --blockSize blocks
+// Gauss-Seidel runs as a wavefront over tiles of at most --tileSize x
+// --tileSize points.
+//
+// The solvers take the layout as a param, so only Stencil arrays get
+// their ghost cells refreshed and nothing is resolved for the others.
+//
+// With --bench=true, every solver is run under every distribution on
+// the first 1, 2, 4, ... locales and one CSV line per run reports the
+// time per iteration and the remote gets, puts and on-statements
+// counted by CommDiagnostics.
+//
+// Usage: ./jacobi-distr -nl <#locales> [--dist=<layout>] [--bench=true]
+//
+// Build with "chpl --fast 04_laplace-distr.chpl -o jacobi-distr" under a
+// multi-locale CHPL_COMM such as gasnet; with CHPL_COMM=none only -nl 1
+// runs and every remote-access count is 0.
+//
+// Written for Chapel 1.30 and 1.31: stopwatch (which replaced Timer in
+// 1.30) and 0-based dim(), with the distributions still named Block,
+// Cyclic, BlockCyclic and Stencil (renamed in 1.32).  Arrays a solver
+// writes are passed by explicit ref rather than by the inferred ref
+// intent, which later releases deprecate.
 // 
 //
 
-use BlockDist;
+use StencilDist, BlockDist, CyclicDist, BlockCycDist;
+use CommDiagnostics, Time;
+
+// distributions of the mesh
+enum layout { block, cyclic, blockCyclic, stencil };
 
 config const epsilon = 0.001;	// convergence tolerance
 config const verbose = false; 	// printing control
 config const n = 8; 	        // mesh size (including boundary)
 
-// Jacobi iteration -- return the iteration count.
-// 
-proc jacobi(D: domain(2), x: [D] real, epsilon: real) { 
-  const ID = D.expand(-1,-1); 	// domain for interior points
-  var xnew: [D] real;           // buffer for new values
-  var delta: real; 		// measure of convergence 
-  var cnt = 0;			// iteration counter
+// Compiling with -seltType=real(32) stores the mesh in single precision
+// while iterating, which halves the memory traffic of a sweep.  The
+// solve is then mixed-precision iterative refinement (solveRefined):
+// corrections are found in real(32) and applied to a real mesh, and
+// the residual is always computed in real.
+//
+config type eltType = real;	// mesh element type while iterating
+config const maxRefine = 10;	// refinement steps, at most
 
-  var xcheck: [D] real = 8.8;   // to check if mapped correctly
-  const BD = ID dmapped Block(boundingBox=ID); //mapping
+// Compiling with -sinstrument=true reports, for every solver, how many
+// interior points each locale updated and the communication it did.
+// The default build carries none of this code.  Under --bench=true the
+// benchmark counts communication itself and the report is skipped.
+//
+config param instrument = false;	// locality/communication report
 
-  do {
-    forall ij in BD do{
-      xnew(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                   + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
+config const dist = layout.stencil;	// distribution of the mesh
+config const blockSize = 8;	// block size for blockCyclic
+config const tileSize = 64;	// Gauss-Seidel tile edge
+config const bench = false;	// compare all distributions
 
-      xcheck(ij) = here.id;
-    }
+// Start counting communication for one solver.  Not under --bench,
+// where resetting the counts would cut into benchLayout's measurement.
+//
+proc startInstrument() {
+  if instrument && !bench {
+    resetCommDiagnostics();
+    startCommDiagnostics();
+  }
+}
 
-    delta = max reduce abs(xnew[ID] - x[ID]);
-    x[ID] = xnew[ID];
+// Stop counting and report per-locale work and communication.  The
+// point counts come from a + reduction over the same distributed
+// domain the solver iterates, so they show where each update ran.
+//
+proc reportInstrument(name: string, ID: domain(2), cnt: int) {
+  if instrument && !bench {
+    stopCommDiagnostics();
+    const comm = getCommDiagnostics();
+
+    var points: [LocaleSpace] int;
+    forall ij in ID with (+ reduce points) do
+      points[here.id] += 1;
+
+    writeln(name, " locality (", cnt, " iterations):");
+    for loc in LocaleSpace do
+      writeln("  locale ", loc, ": points/sweep ", points[loc],
+              ", gets ", comm[loc].get + comm[loc].get_nb,
+              ", puts ", comm[loc].put + comm[loc].put_nb,
+              ", on-stmts ", comm[loc].execute_on
+                             + comm[loc].execute_on_fast
+                             + comm[loc].execute_on_nb);
+  }
+}
+
+// The mesh domain, boundary included, distributed by L over the
+// locales tl.
+//
+proc meshDomain(param L: layout, tl: [] locale) {
+  const bb = {0..n-1, 0..n-1};
+  if L == layout.block then
+    return bb dmapped Block(boundingBox=bb, targetLocales=tl);
+  else if L == layout.cyclic then
+    return bb dmapped Cyclic(startIdx=bb.low, targetLocales=tl);
+  else if L == layout.blockCyclic then
+    return bb dmapped BlockCyclic(startIdx=bb.low,
+                                  blocksize=(blockSize, blockSize),
+                                  targetLocales=tl);
+  else
+    return bb dmapped Stencil(boundingBox=bb, fluff=(1,1),
+                              targetLocales=tl);
+}
+
+// Source term of the correction equation at ij, or 0 when the solver
+// was called without one.
+//
+inline proc source(f, ij, type t) {
+  if f.type == nothing then return 0:t;
+  else return f(ij);
+}
 
+// Refresh the ghost cells of x, distributed by L.  Only Stencil has
+// them; under the other distributions remote neighbours are read
+// directly.
+//
+proc refresh(param L: layout, x) {
+  if L == layout.stencil then
+    x.updateFluff();
+}
+
+// One Jacobi sweep from x into xnew -- return the largest change.
+// The update and the convergence measure share a single pass.
+//
+proc jacobi_sweep(param L: layout, ID: domain(2), x: [] ?t, ref xnew: [] t,
+                  f) {
+  var delta: t;
+  refresh(L, x);
+  forall ij in ID with (max reduce delta) do {
+    xnew(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
+                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4:t + source(f, ij, t);
+    delta reduce= abs(xnew(ij) - x(ij));
+  }
+  return delta;
+}
+
+// Jacobi iteration -- return the iteration count.  With a source term
+// f, every solver here solves x = avg(x) + f instead of x = avg(x).
+//
+// The two buffers are used in turn (x into xnew, then xnew back into x)
+// so no copy is needed between iterations.
+// 
+proc jacobi(param L: layout, D: domain(2), ref x: [D] ?t, epsilon: real,
+            f = none) { 
+  const ID = D.expand(-1,-1); 	// domain for interior points
+  var xnew: [D] t = x;          // second buffer, boundary copied once
+  var delta: t; 		// measure of convergence 
+  var cnt = 0;			// iteration counter
+
+  startInstrument();
+  do {
+    delta = jacobi_sweep(L, ID, x, xnew, f);
     cnt += 1;
     if (verbose) {
       writeln("Iter: ", cnt, " (delta=", delta, ")\n");
-      writeln(x);
-      writeln("Jacobi mapping:");
-      writeln(xcheck);
+      writeln(xnew);
+    }
+
+    if (delta > epsilon) {
+      delta = jacobi_sweep(L, ID, xnew, x, f);
+      cnt += 1;
+      if (verbose) {
+        writeln("Iter: ", cnt, " (delta=", delta, ")\n");
+        writeln(x);
+      }
+    }
+    else {
+      x[ID] = xnew[ID];         // converged into the second buffer
     }
   } while (delta > epsilon);
+
+  reportInstrument("Jacobi", ID, cnt);
   return cnt;
 }
 
-proc gauss_seidel(D: domain(2), x: [D] real, epsilon: real) {
-  const ID = D.expand(-1, -1); //domain for interior points
-  var cnt = 0;                 //iteration counter
-
-  //new array to check that mapping is correct
-  var xcheck: [D] real = 8.8;
-
-  //mapping   
-  const BD = ID dmapped Block(boundingBox=ID);
+// Start indices of the Gauss-Seidel tiles along dimension k of the
+// interior lo..hi, followed by hi+1: every tileSize points, and under
+// Block and Stencil also every edge of a locale's block, so no tile
+// spans two locales.
+//
+proc tileStarts(param L: layout, x, k: int, lo: int, hi: int) {
+  var edge: [lo..hi+1] bool;
+  for s in lo..hi by tileSize do
+    edge[s] = true;
+  edge[hi+1] = true;
+  if L == layout.block || L == layout.stencil then
+    for loc in x.targetLocales() {
+      const r = x.localSubdomain(loc).dim(k);
+      if r.size > 0 && r.low > lo && r.low <= hi then
+        edge[r.low] = true;
+    }
 
-  //boolean variables to check if delta < epsilon
-  //and if any one delta is > epsilon.  If any is >
-  //epsilon, need to keep calculating
-  var flag1: bool = false;
-  var flag2: bool = false;
+  var starts: [0..#(+ reduce (edge:int))] int;
+  var m = 0;
+  for s in lo..hi+1 do
+    if edge[s] {
+      starts[m] = s;
+      m += 1;
+    }
+  return starts;
+}
 
+// Gauss-Seidel iteration -- return the iteration count.
+//
+// The interior is cut into T x U tiles (tileStarts) and swept as a
+// wavefront: tiles on one tile diagonal I+J = p only read tiles of the
+// previous diagonal (already updated) and of the next one (not yet
+// updated), so they run in parallel, each on the locale owning it and
+// row by row inside, which gives exactly the sequential row-by-row
+// result.
+//
+// Cost per sweep: T+U-1 phases, each ending in one global barrier and,
+// under Stencil, one updateFluff(), instead of one of each per
+// anti-diagonal of points (2n-5).  A phase keeps at most min(T, U)
+// tiles busy, so smaller tiles fill the pipeline sooner at the price of
+// more phases.  Under Cyclic and BlockCyclic tiles are not aligned with
+// what a locale owns and most neighbour reads stay remote.
+//
+proc gauss_seidel(param L: layout, D: domain(2), ref x: [D] ?t, epsilon: real,
+                  f = none) {
+  const ID = D.expand(-1, -1); //domain for interior points
+  const (rlo, clo) = ID.low;
+  const (rhi, chi) = ID.high;
+  const rs = tileStarts(L, x, 0, rlo, rhi);  //tile row starts
+  const cs = tileStarts(L, x, 1, clo, chi);  //tile column starts
+  const T = rs.size - 1, U = cs.size - 1;     //tile rows and columns
+  var delta: t;                //measure of convergence
+  var cnt = 0;                 //iteration counter
 
+  startInstrument();
   do {
-    //initialize on each iteration
-    flag1 = false;
-    flag2 = false;
+    delta = 0:t;
 
-    forall ij in BD with (ref flag1, ref flag2) do{ 
-      var temp: real = x(ij);
+    for p in 0..T+U-2 {
+      refresh(L, x);
 
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
+      coforall I in max(0, p-U+1)..min(p, T-1) with (max reduce delta) {
+        const J = p - I;
+        const (ilo, ihi) = (rs[I], rs[I+1]-1);
+        const (jlo, jhi) = (cs[J], cs[J+1]-1);
 
-      xcheck(ij) = here.id;
+        on x[ilo, jlo] {
+          for i in ilo..ihi {
+            for j in jlo..jhi {
+              const temp = x(i,j);
 
-      var my_delta = abs(x(ij) - temp);
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
+              x(i,j) = (x(i,j+1) + x(i,j-1) 
+                          + x(i+1,j) + x(i-1,j)) / 4:t
+                       + source(f, (i,j), t);
+
+              delta reduce= abs(x(i,j) - temp);
+            }
+          }
+        }
       }
     }
 
     cnt += 1;
-
     if (verbose) {
-      writeln("Iter: ", cnt, "\n");
+      writeln("Iter: ", cnt, " (delta=", delta, ")\n");
       writeln(x);
-      writeln("Gauss-Seidel mapping:");
-      writeln(xcheck);
     }
+  } while (delta > epsilon);
 
-  } while (!(flag1 && !flag2));
-
+  reportInstrument("Gauss-Seidel", ID, cnt);
   return cnt;
 }
 
-proc red_black(D: domain(2), x: [D] real, epsilon: real) {
+// Red/black iteration -- return the iteration count.
+//
+proc red_black(param L: layout, D: domain(2), ref x: [D] ?t, epsilon: real,
+               f = none) {
 
   //domain for interior points
   const ID = D.expand(-1,-1); 
 
-  //even domains
-  const E1 = {2..n-2 by 2, 2..n-2 by 2};
-  const E2 = {1..n-2 by 2, 1..n-2 by 2};
+  //red points (i+j even) are the strided subdomains E1 and E2, black
+  //points (i+j odd) O1 and O2, as in 04_laplace-shm.chpl; slicing the
+  //distributed interior keeps every point on the locale that owns it
+  const E1 = ID[2..n-2 by 2, 2..n-2 by 2];
+  const E2 = ID[1..n-2 by 2, 1..n-2 by 2];
+  const O1 = ID[2..n-2 by 2, 1..n-2 by 2];
+  const O2 = ID[1..n-2 by 2, 2..n-2 by 2];
 
-  //odd domains
-  const O1 = {2..n-2 by 2, 1..n-2 by 2};
-  const O2 = {1..n-2 by 2, 2..n-2 by 2};
-
-  //counter
+  //measure of convergence and counter
+  var delta: t;
   var cnt = 0;
 
-  //new array to check on mapping
-  var xcheck: [D] real = 8.8;   
-
-  //mapping evens and odds
-  const BE1 = E1 dmapped Block(boundingBox=ID); //mapping
-  const BE2 = E2 dmapped Block(boundingBox=ID); //mapping
-  const BO1 = O1 dmapped Block(boundingBox=ID); //mapping
-  const BO2 = O2 dmapped Block(boundingBox=ID); //mapping
-
-  //flags to check if delta < epsilon and if any one delta > epsilon.
-  //If any is > epsilon, need to keep calculating
-  var flag1: bool;
-  var flag2: bool;
-
+  startInstrument();
   do {
-    //initialize on each iteration
-    flag1 = false;
-    flag2 = false;
-
-    forall ij in BE1 with (ref flag1, ref flag2) do {
-      var temp: real = x(ij);
-
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
-
-      xcheck(ij) = here.id;
-
-      var my_delta = abs(x(ij) - temp);
-
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
-      }
-    }
-
-    forall ij in BE2 with (ref flag1, ref flag2) do {
-      var temp: real = x(ij);
-
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
-
-      xcheck(ij) = here.id;
-
-      var my_delta = abs(x(ij) - temp);
-
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
-      }
-    }
-
-    forall ij in BO1 with (ref flag1, ref flag2) do {
-      var temp: real = x(ij);
-
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
-
-      xcheck(ij) = here.id;
-
-      var my_delta = abs(x(ij) - temp);
-
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
-      }
-    }
-
-    forall ij in BO2 with (ref flag1, ref flag2) do {
-      var temp: real = x(ij);
+    delta = 0:t;
 
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
+    //red points first, then black points; the ghost cells are
+    //refreshed before each color since it reads the other color's
+    //new values
+    for color in ((E1, E2), (O1, O2)) {
+      refresh(L, x);
 
-      xcheck(ij) = here.id;
+      for C in color {
+        forall ij in C with (max reduce delta) do {
+          const temp = x(ij);
 
-      var my_delta = abs(x(ij) - temp);
+          x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
+                     + x(ij+(1,0)) + x(ij+(-1,0))) / 4:t + source(f, ij, t);
 
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
+          delta reduce= abs(x(ij) - temp);
+        }
       }
     }
     
     cnt += 1;
-
     if (verbose) {
-      writeln("Iter: ", cnt, "\n");
+      writeln("Iter: ", cnt, " (delta=", delta, ")\n");
       writeln(x);
-      writeln("Red-Black mapping:");
-      writeln(xcheck);
     }
+  } while (delta > epsilon);
 
-  } while (!(flag1 && !flag2)); 
+  reportInstrument("Red-Black", ID, cnt);
   return cnt;
 }
 
+// Defect d = avg(x) - x of every interior point, in real -- return the
+// largest |d|, the residual.  d is left unchanged on the boundary.
+//
+proc defect(param L: layout, D: domain(2), x: [D] real, ref d: [D] real) {
+  const ID = D.expand(-1,-1);
+  var r: real;
+  refresh(L, x);
+  forall ij in ID with (max reduce r) do {
+    d(ij) = (x(ij+(0,1)) + x(ij+(0,-1))
+             + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0 - x(ij);
+    r reduce= abs(d(ij));
+  }
+  return r;
+}
 
+// Run method on x, with the source term f if one is given -- return
+// the iteration count.
+//
+proc run(param L: layout, param method: string, D: domain(2), ref x,
+         f = none) {
+  if method == "jacobi" then return jacobi(L, D, x, epsilon, f);
+  else if method == "gauss_seidel" then
+    return gauss_seidel(L, D, x, epsilon, f);
+  else return red_black(L, D, x, epsilon, f);
+}
 
-// Main routine.
+// Solve x with method by mixed-precision iterative refinement -- return
+// the iterations, the refinement steps and the residual.
 //
-proc main() {
-  const D = {0..n-1, 0..n-1};   // domain including boundary points
+// Each step computes the defect d of x in real, solves e = avg(e) + d
+// with e = 0 on the boundary in eltType and adds e to x in real, until
+// the residual is at most epsilon.  With real storage the method runs
+// on x directly.
+//
+proc solveRefined(param L: layout, param method: string, D: domain(2),
+                  ref x: [D] real) {
+  const ID = D.expand(-1,-1);
+  var d: [D] real;
+  var cnt = 0, steps = 0;
+
+  if eltType == real then
+    cnt = run(L, method, D, x);
+  var r = defect(L, D, x, d);
+
+  if eltType != real {
+    var e, f: [D] eltType;
+    while r > epsilon && steps < maxRefine {
+      forall ij in D do {
+        f(ij) = d(ij): eltType;
+        e(ij) = 0: eltType;
+      }
+      cnt += run(L, method, D, e, f);
+      forall ij in ID do
+        x(ij) += e(ij): real;
+      steps += 1;
+      r = defect(L, D, x, d);
+    }
+  }
+  return (cnt, steps, r);
+}
+
+// Solve with all three methods, the mesh distributed by L.
+//
+proc solve(param L: layout) {
+  // domain including boundary points
+  const D = meshDomain(L, Locales);
+  writeln("Distribution: ", L, ", locales: ", numLocales, "\n");
   var a: [D] real = 0.0;	// mesh array
-  a[n-1, 0..n-1] = 1.0;         // - setting boundary values
+  a[n-1, 0..n-1] = 1.0;   // - setting boundary values
   a[0..n-1, n-1] = 1.0;
-  var cnt = jacobi(D, a, epsilon);
+  var (cnt, steps, res) = solveRefined(L, "jacobi", D, a);
   writeln("Jacobi:");
   writeln("Mesh size: ", n, " x ", n, ", epsilon=", epsilon, 
             ", total Jacobi iterations: ", cnt);
+  writeln(eltType:string, " storage, refinement steps: ", steps,
+          ", residual: ", res);
 //  writeln(a);
   writeln("");
 
@@ -243,10 +424,13 @@ proc main() {
   a[0..n-1, n-1] = 1.0;
  
   //gauss-seidel method
-  var gs_cnt = gauss_seidel(D, a, epsilon);
+  var gs_cnt: int;
+  (gs_cnt, steps, res) = solveRefined(L, "gauss_seidel", D, a);
   writeln("Gauss-Seidel:");
   writeln("Mesh size: ", n, " x ", n, ", epslon: ", epsilon, 
           ", Gauss-Seidel iterations: ", gs_cnt);
+  writeln(eltType:string, " storage, refinement steps: ", steps,
+          ", residual: ", res);
 //  writeln(a);
   writeln("");
 
@@ -256,11 +440,75 @@ proc main() {
   a[0..n-1, n-1] = 1.0;
 
   //red-black method
-  var rb_cnt = red_black(D, a, epsilon);
+  var rb_cnt: int;
+  (rb_cnt, steps, res) = solveRefined(L, "red_black", D, a);
   writeln("Red-Black:");
   writeln("Mesh size: ", n, " x ", n, ", epsilon: ", epsilon, 
           ", iterations: ", rb_cnt);
+  writeln(eltType:string, " storage, refinement steps: ", steps,
+          ", residual: ", res);
 //  writeln(a);
   writeln("");
 
 }
+
+// Run every solver with the mesh distributed by L over the first k
+// locales, k = 1, 2, 4, ..., numLocales, and print one CSV line per
+// run.  Communication is counted for the whole solve.
+//
+proc benchLayout(param L: layout) {
+  const name = ["jacobi", "gauss_seidel", "red_black"];
+  var k = 1;
+
+  while k <= numLocales {
+    const D = meshDomain(L, Locales[0..#k]);
+    var a: [D] eltType;
+
+    for param m in 0..2 {
+      a = 0:eltType;
+      a[n-1, 0..n-1] = 1:eltType;
+      a[0..n-1, n-1] = 1:eltType;
+
+      var t: stopwatch;
+      resetCommDiagnostics();
+      startCommDiagnostics();
+      t.start();
+      const cnt = if m == 0 then jacobi(L, D, a, epsilon)
+                  else if m == 1 then gauss_seidel(L, D, a, epsilon)
+                  else red_black(L, D, a, epsilon);
+      t.stop();
+      stopCommDiagnostics();
+
+      var gets, puts, ons: int;
+      for c in getCommDiagnostics() {
+        gets += c.get + c.get_nb;
+        puts += c.put + c.put_nb;
+        ons += c.execute_on + c.execute_on_fast + c.execute_on_nb;
+      }
+      writeln(name[m], ",", L, ",", k, ",", cnt, ",", t.elapsed() / cnt,
+              ",", gets, ",", puts, ",", ons);
+    }
+
+    k = if k == numLocales then k + 1 else min(2 * k, numLocales);
+  }
+}
+
+// Main routine.
+//
+proc main() {
+  if bench {
+    writeln("solver,layout,locales,iterations,sec_per_iter,gets,puts,ons");
+    benchLayout(layout.stencil);
+    benchLayout(layout.block);
+    benchLayout(layout.cyclic);
+    benchLayout(layout.blockCyclic);
+    return;
+  }
+
+  select dist {
+    when layout.stencil do solve(layout.stencil);
+    when layout.block do solve(layout.block);
+    when layout.cyclic do solve(layout.cyclic);
+    when layout.blockCyclic do solve(layout.blockCyclic);
+  }
+}
@@ -0,0 +1,607 @@
+//-------------------------------------------------------------------------
+// This is supporting software for CS415/515 Parallel Programming.
+// Copyright (c) Portland State University
+//-------------------------------------------------------------------------
+
+// Distributed Jacobi and red/black methods for solving a Laplace equation.
+//
+// The interior (n-2)x(n-2) points of the mesh are block partitioned over
+// a 2D Cartesian process grid.  Each process keeps its block plus one
+// layer of ghost cells.  Ghost cells on the global edge hold the fixed
+// boundary values; all other ghost cells are refreshed every sweep with
+// nonblocking halo exchanges that overlap the update of the block's
+// interior.  Convergence is checked with an MPI_Allreduce of the local
+// deltas.
+//
+// Lexicographic Gauss-Seidel has no parallelism across blocks, so only
+// Jacobi and red/black are distributed here.
+//
+// With -c the solvers checkpoint the mesh every <every> iterations
+// (default CKPT_EVERY) and when they converge, in the binary format of
+// laplace_ckpt.h.  A checkpoint is one collective nonblocking write,
+// MPI_File_iwrite_all, of every block into <ckptfile>.tmp through a
+// subarray file view.  It proceeds while the solver keeps iterating and
+// is completed at the next checkpoint, when rank 0 renames the file
+// over <ckptfile>.  -r resumes the method recorded in a checkpoint
+// (written by this program or by 04_laplace.c, with any number of
+// processes); each process reads just its block with a collective
+// read.
+//
+// Usage:
+//   linux> mpirun -hostfile <hostfile> -n <#processes> laplace-mpi
+//          [-c <ckptfile>] [-k <every>] [-r <ckptfile>] [<N>]
+//
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <mpi.h>
+#include "laplace_ckpt.h"
+
+#define EPSILON 0.001 	// convergence tolerance
+#define VERBOSE 0 	// printing control
+#define TAG 1001
+
+// Process grid and the block this process owns.
+//
+typedef struct grid_ {
+  MPI_Comm comm;	// 2D Cartesian communicator
+  int rank, nprocs;
+  int dims[2];		// process grid dimensions
+  int coords[2];	// my position in the process grid
+  int up, down, left, right;	// neighbors (MPI_PROC_NULL on the edge)
+  int lr, lc;		// rows and columns of my block
+  int row0, col0;	// global index = local index + row0 / col0
+  MPI_Datatype column;	// one column of the block (strided)
+} grid_t;
+
+// Number of points and offset of block <coord> when <len> points are
+// split into <parts> nearly equal blocks.
+//
+int block_size(int len, int parts, int coord) {
+  return len / parts + (coord < len % parts);
+}
+
+int block_start(int len, int parts, int coord) {
+  int rem = len % parts;
+  return coord * (len / parts) + (coord < rem ? coord : rem);
+}
+
+// Set up the Cartesian communicator and my block of the mesh.
+//
+void init_grid(grid_t *g, int n) {
+  int periods[2] = {0, 0};
+
+  MPI_Comm_size(MPI_COMM_WORLD, &g->nprocs);
+  g->dims[0] = g->dims[1] = 0;
+  MPI_Dims_create(g->nprocs, 2, g->dims);
+  MPI_Cart_create(MPI_COMM_WORLD, 2, g->dims, periods, 1, &g->comm);
+  MPI_Comm_rank(g->comm, &g->rank);
+  MPI_Cart_coords(g->comm, g->rank, 2, g->coords);
+  MPI_Cart_shift(g->comm, 0, 1, &g->up, &g->down);
+  MPI_Cart_shift(g->comm, 1, 1, &g->left, &g->right);
+
+  g->lr = block_size(n-2, g->dims[0], g->coords[0]);
+  g->lc = block_size(n-2, g->dims[1], g->coords[1]);
+  g->row0 = block_start(n-2, g->dims[0], g->coords[0]);
+  g->col0 = block_start(n-2, g->dims[1], g->coords[1]);
+
+  MPI_Type_vector(g->lr, 1, g->lc+2, MPI_DOUBLE, &g->column);
+  MPI_Type_commit(&g->column);
+}
+
+void free_grid(grid_t *g) {
+  MPI_Type_free(&g->column);
+  MPI_Comm_free(&g->comm);
+}
+
+// Initialize my block with the same boundary conditions as the
+// sequential version: the last row and column of the mesh are 1.0,
+// everything else starts at 0.
+//
+void init_array(grid_t *g, double a[g->lr+2][g->lc+2]) {
+  int i, j;
+  for (i = 0; i < g->lr+2; i++) {
+    for (j = 0; j < g->lc+2; j++)
+      a[i][j] = 0;
+  }
+  if (g->down == MPI_PROC_NULL) {
+    for (j = 1; j <= g->lc; j++)
+      a[g->lr+1][j] = 1.0;
+  }
+  if (g->right == MPI_PROC_NULL) {
+    for (i = 1; i <= g->lr; i++)
+      a[i][g->lc+1] = 1.0;
+  }
+}
+
+// Post the halo exchange for my block.  Rows are contiguous, columns go
+// through the strided column type.  Completes with MPI_Waitall on req[8].
+//
+void start_halo(grid_t *g, double x[g->lr+2][g->lc+2], MPI_Request req[8]) {
+  int lr = g->lr, lc = g->lc;
+
+  MPI_Irecv(&x[0][1], lc, MPI_DOUBLE, g->up, TAG, g->comm, &req[0]);
+  MPI_Irecv(&x[lr+1][1], lc, MPI_DOUBLE, g->down, TAG, g->comm, &req[1]);
+  MPI_Irecv(&x[1][0], 1, g->column, g->left, TAG, g->comm, &req[2]);
+  MPI_Irecv(&x[1][lc+1], 1, g->column, g->right, TAG, g->comm, &req[3]);
+
+  MPI_Isend(&x[1][1], lc, MPI_DOUBLE, g->up, TAG, g->comm, &req[4]);
+  MPI_Isend(&x[lr][1], lc, MPI_DOUBLE, g->down, TAG, g->comm, &req[5]);
+  MPI_Isend(&x[1][1], 1, g->column, g->left, TAG, g->comm, &req[6]);
+  MPI_Isend(&x[1][lc], 1, g->column, g->right, TAG, g->comm, &req[7]);
+}
+
+// Jacobi update of rows i0..i1, columns j0..j1 of my block.
+// Return the largest change.
+//
+double jacobi_region(grid_t *g, double x[g->lr+2][g->lc+2],
+                     double xnew[g->lr+2][g->lc+2],
+                     int i0, int i1, int j0, int j1) {
+  double delta = 0.0;
+  for (int i = i0; i <= i1; i++) {
+    for (int j = j0; j <= j1; j++) {
+      xnew[i][j] = (x[i-1][j] + x[i][j-1] + x[i+1][j] + x[i][j+1]) / 4.0;
+      delta = fmax(delta, fabs(xnew[i][j] - x[i][j]));
+    }
+  }
+  return delta;
+}
+
+// Red/black update of the points of one color in rows i0..i1, columns
+// j0..j1 of my block.  Color is taken from the global index so that
+// all blocks agree on it.  Return the largest change.
+//
+double color_region(grid_t *g, double x[g->lr+2][g->lc+2], int color,
+                    int i0, int i1, int j0, int j1) {
+  double delta = 0.0, temp;
+  for (int i = i0; i <= i1; i++) {
+    int j = j0 + ((g->row0 + i + g->col0 + j0 + color) % 2);
+    for (; j <= j1; j += 2) {
+      temp = x[i][j];
+      x[i][j] = (x[i-1][j] + x[i][j-1] + x[i+1][j] + x[i][j+1]) / 4.0;
+      delta = fmax(delta, fabs(x[i][j] - temp));
+    }
+  }
+  return delta;
+}
+
+// Update the inner part of the block, which needs no ghost cells, while
+// the halo exchange is in flight; then finish the one-point rim.
+//
+double jacobi_sweep(grid_t *g, double x[g->lr+2][g->lc+2],
+                    double xnew[g->lr+2][g->lc+2]) {
+  int lr = g->lr, lc = g->lc;
+  MPI_Request req[8];
+  double delta;
+
+  start_halo(g, x, req);
+  delta = jacobi_region(g, x, xnew, 2, lr-1, 2, lc-1);
+  MPI_Waitall(8, req, MPI_STATUSES_IGNORE);
+
+  delta = fmax(delta, jacobi_region(g, x, xnew, 1, 1, 1, lc));
+  if (lr > 1)
+    delta = fmax(delta, jacobi_region(g, x, xnew, lr, lr, 1, lc));
+  if (lr > 2) {
+    delta = fmax(delta, jacobi_region(g, x, xnew, 2, lr-1, 1, 1));
+    if (lc > 1)
+      delta = fmax(delta, jacobi_region(g, x, xnew, 2, lr-1, lc, lc));
+  }
+  return delta;
+}
+
+double color_sweep(grid_t *g, double x[g->lr+2][g->lc+2], int color) {
+  int lr = g->lr, lc = g->lc;
+  MPI_Request req[8];
+  double delta;
+
+  start_halo(g, x, req);
+  delta = color_region(g, x, color, 2, lr-1, 2, lc-1);
+  MPI_Waitall(8, req, MPI_STATUSES_IGNORE);
+
+  delta = fmax(delta, color_region(g, x, color, 1, 1, 1, lc));
+  if (lr > 1)
+    delta = fmax(delta, color_region(g, x, color, lr, lr, 1, lc));
+  if (lr > 2) {
+    delta = fmax(delta, color_region(g, x, color, 2, lr-1, 1, 1));
+    if (lc > 1)
+      delta = fmax(delta, color_region(g, x, color, 2, lr-1, lc, lc));
+  }
+  return delta;
+}
+
+// Gather the whole mesh on rank 0 and display it.
+//
+void print_array(grid_t *g, int n, double a[g->lr+2][g->lc+2]) {
+  int lr = g->lr, lc = g->lc;
+
+  if (g->rank != 0) {
+    int info[4] = {g->row0, g->col0, lr, lc};
+    double *buf = (double *) malloc(sizeof(double) * lr * lc);
+    for (int i = 0; i < lr; i++)
+      for (int j = 0; j < lc; j++)
+        buf[i*lc + j] = a[i+1][j+1];
+    MPI_Send(info, 4, MPI_INT, 0, TAG, g->comm);
+    MPI_Send(buf, lr * lc, MPI_DOUBLE, 0, TAG, g->comm);
+    free(buf);
+    return;
+  }
+
+  double (*mesh)[n] = malloc(sizeof(double) * n * n);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      mesh[i][j] = 0;
+  for (int i = 1; i < n-1; i++) {
+    mesh[n-1][i] = 1.0;
+    mesh[i][n-1] = 1.0;
+  }
+  for (int i = 0; i < lr; i++)
+    for (int j = 0; j < lc; j++)
+      mesh[i+1][j+1] = a[i+1][j+1];
+
+  for (int p = 1; p < g->nprocs; p++) {
+    int info[4];
+    MPI_Status status;
+    MPI_Recv(info, 4, MPI_INT, MPI_ANY_SOURCE, TAG, g->comm, &status);
+    double *buf = (double *) malloc(sizeof(double) * info[2] * info[3]);
+    MPI_Recv(buf, info[2] * info[3], MPI_DOUBLE, status.MPI_SOURCE, TAG,
+             g->comm, MPI_STATUS_IGNORE);
+    for (int i = 0; i < info[2]; i++)
+      for (int j = 0; j < info[3]; j++)
+        mesh[info[0]+i+1][info[1]+j+1] = buf[i*info[3] + j];
+    free(buf);
+  }
+
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++)
+      printf("%8.4f ", mesh[i][j]);
+    printf("\n");
+  }
+  free(mesh);
+}
+
+// Checkpoint state.  My part of the mesh in the file is my block plus
+// the ghost cells that lie on the global edge: local rows r0..r1 and
+// columns c0..c1.
+//
+typedef struct ckpt_ {
+  const char *file;
+  char *tmp;		// <file>.tmp
+  int n, every;
+  int method, start;	// method to resume and its iteration count
+  int r0, r1, c0, c1;
+  MPI_Datatype filetype;	// my part of the n x n mesh
+  double *snap;		// my part, packed
+  int pending;		// write in flight
+  MPI_File fh;
+  MPI_Request req;
+  int written;
+} ckpt_t;
+
+ckpt_t *ckpt = NULL;	// checkpointing, if on
+
+ckpt_t *ckpt_open(grid_t *g, const char *file, int every, int n) {
+  ckpt_t *c = (ckpt_t *) calloc(1, sizeof(ckpt_t));
+  int sizes[2] = {n, n}, sub[2], start[2];
+
+  c->file = file;
+  c->tmp = (char *) malloc(strlen(file) + 5);
+  sprintf(c->tmp, "%s.tmp", file);
+  c->n = n;
+  c->every = every;
+  c->method = -1;
+  c->r0 = (g->up == MPI_PROC_NULL) ? 0 : 1;
+  c->r1 = (g->down == MPI_PROC_NULL) ? g->lr+1 : g->lr;
+  c->c0 = (g->left == MPI_PROC_NULL) ? 0 : 1;
+  c->c1 = (g->right == MPI_PROC_NULL) ? g->lc+1 : g->lc;
+  sub[0] = c->r1 - c->r0 + 1;
+  sub[1] = c->c1 - c->c0 + 1;
+  start[0] = g->row0 + c->r0;
+  start[1] = g->col0 + c->c0;
+  MPI_Type_create_subarray(2, sizes, sub, start, MPI_ORDER_C, MPI_DOUBLE,
+                           &c->filetype);
+  MPI_Type_commit(&c->filetype);
+  c->snap = (double *) malloc(sizeof(double) * sub[0] * sub[1]);
+  return c;
+}
+
+// Complete the write in flight and move the file into place.
+//
+void ckpt_finish(grid_t *g, ckpt_t *c) {
+  if (!c->pending)
+    return;
+  MPI_Wait(&c->req, MPI_STATUS_IGNORE);
+  MPI_File_sync(c->fh);
+  MPI_File_close(&c->fh);
+  MPI_Barrier(g->comm);
+  if (g->rank == 0 && rename(c->tmp, c->file))
+    perror(c->file);
+  c->pending = 0;
+  c->written++;
+}
+
+void ckpt_close(grid_t *g, ckpt_t *c) {
+  ckpt_finish(g, c);
+  if (g->rank == 0)
+    printf("Checkpoints: %d written to %s\n", c->written, c->file);
+  MPI_Type_free(&c->filetype);
+  free(c->snap);
+  free(c->tmp);
+  free(c);
+}
+
+// Iteration count a solver of <method> starts from: the resumed one
+// once, 0 otherwise.
+//
+int ckpt_start(int method) {
+  int start = 0;
+  if (ckpt && ckpt->method == method) {
+    start = ckpt->start;
+    ckpt->method = -1;
+  }
+  return start;
+}
+
+// Called by all processes after iteration cnt; checkpoints every
+// <every> iterations, and always (completing the write) if last.
+//
+void ckpt_step(grid_t *g, int method, double x[g->lr+2][g->lc+2], int cnt,
+               double delta, int last) {
+  ckpt_t *c = ckpt;
+  ckpt_header_t hdr;
+  int k = 0;
+
+  if (!c || (!last && cnt % c->every))
+    return;
+
+  ckpt_finish(g, c);
+  for (int i = c->r0; i <= c->r1; i++)
+    for (int j = c->c0; j <= c->c1; j++)
+      c->snap[k++] = x[i][j];
+
+  MPI_File_open(g->comm, c->tmp, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                MPI_INFO_NULL, &c->fh);
+  MPI_File_set_size(c->fh, ckpt_offset(c->n, c->n, 0));
+  if (g->rank == 0) {
+    ckpt_fill_header(&hdr, c->n, method, cnt, delta);
+    MPI_File_write_at(c->fh, 0, &hdr, sizeof(hdr), MPI_BYTE,
+                      MPI_STATUS_IGNORE);
+  }
+  MPI_File_set_view(c->fh, sizeof(ckpt_header_t), MPI_DOUBLE, c->filetype,
+                    "native", MPI_INFO_NULL);
+  MPI_File_iwrite_all(c->fh, c->snap, k, MPI_DOUBLE, &c->req);
+  c->pending = 1;
+  if (last)
+    ckpt_finish(g, c);
+}
+
+// Read checkpoint <file>'s header on all processes.  Return 0 if it
+// is not a valid checkpoint.
+//
+int ckpt_read_header(const char *file, ckpt_header_t *hdr) {
+  MPI_File fh;
+  MPI_Offset size;
+
+  if (MPI_File_open(MPI_COMM_WORLD, file, MPI_MODE_RDONLY, MPI_INFO_NULL,
+                    &fh) != MPI_SUCCESS)
+    return 0;
+  MPI_File_get_size(fh, &size);
+  memset(hdr, 0, sizeof(*hdr));
+  if (size >= (MPI_Offset) sizeof(*hdr))
+    MPI_File_read_at_all(fh, 0, hdr, sizeof(*hdr), MPI_BYTE,
+                         MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+  return ckpt_valid(hdr, size);
+}
+
+// Read my part of the mesh in checkpoint <file> into a.
+//
+void ckpt_load(grid_t *g, ckpt_t *c, const char *file,
+               double a[g->lr+2][g->lc+2]) {
+  MPI_File fh;
+  int len = (c->r1 - c->r0 + 1) * (c->c1 - c->c0 + 1), k = 0;
+
+  MPI_File_open(g->comm, file, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+  MPI_File_set_view(fh, sizeof(ckpt_header_t), MPI_DOUBLE, c->filetype,
+                    "native", MPI_INFO_NULL);
+  MPI_File_read_all(fh, c->snap, len, MPI_DOUBLE, MPI_STATUS_IGNORE);
+  MPI_File_close(&fh);
+  for (int i = c->r0; i <= c->r1; i++)
+    for (int j = c->c0; j <= c->c1; j++)
+      a[i][j] = c->snap[k++];
+}
+
+// Jacobi iteration -- return the iteration count.  The two buffers are
+// swapped instead of copying back; the result is left in x.
+//
+int jacobi(grid_t *g, double (*x)[g->lc+2], double epsilon) {
+  int lr = g->lr, lc = g->lc;
+  double (*xnew)[lc+2] = malloc(sizeof(double) * (lr+2) * (lc+2));
+  double (*cur)[lc+2] = x, (*nxt)[lc+2] = xnew, (*tmp)[lc+2];
+  double delta, my_delta;
+  int cnt = ckpt_start(CKPT_JACOBI);
+
+  // ghost cells on the global edge must be valid in both buffers
+  for (int i = 0; i < lr+2; i++)
+    for (int j = 0; j < lc+2; j++)
+      xnew[i][j] = x[i][j];
+
+  do {
+    my_delta = jacobi_sweep(g, cur, nxt);
+    MPI_Allreduce(&my_delta, &delta, 1, MPI_DOUBLE, MPI_MAX, g->comm);
+    tmp = cur; cur = nxt; nxt = tmp;
+    cnt++;
+    if (VERBOSE && g->rank == 0)
+      printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
+    ckpt_step(g, CKPT_JACOBI, cur, cnt, delta, delta <= epsilon);
+  } while (delta > epsilon);
+
+  if (cur != x) {
+    for (int i = 1; i <= lr; i++)
+      for (int j = 1; j <= lc; j++)
+        x[i][j] = cur[i][j];
+  }
+  free(xnew);
+  return cnt;
+}
+
+// Red/black method -- return the iteration count.
+//
+int red_black(grid_t *g, double (*x)[g->lc+2], double epsilon) {
+  double delta, my_delta;
+  int cnt = ckpt_start(CKPT_RED_BLACK);
+
+  do {
+    my_delta = color_sweep(g, x, 0);
+    my_delta = fmax(my_delta, color_sweep(g, x, 1));
+    MPI_Allreduce(&my_delta, &delta, 1, MPI_DOUBLE, MPI_MAX, g->comm);
+    cnt++;
+    if (VERBOSE && g->rank == 0)
+      printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
+    ckpt_step(g, CKPT_RED_BLACK, x, cnt, delta, delta <= epsilon);
+  } while (delta > epsilon);
+  return cnt;
+}
+
+// Main routine.
+//
+int main(int argc, char **argv) {
+  grid_t g;
+  double begin, end;
+  const char *ckptfile = NULL, *restart = NULL;
+  int every = CKPT_EVERY, rank, opt;
+  ckpt_header_t hdr;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  while ((opt = getopt(argc, argv, "c:k:r:")) != -1) {
+    switch (opt) {
+    case 'c': ckptfile = optarg; break;
+    case 'k': every = atoi(optarg); break;
+    case 'r': restart = optarg; break;
+    default: every = 0;
+    }
+  }
+  if (every < 1) {
+    if (rank == 0)
+      printf("Usage: laplace-mpi [-c <ckptfile>] [-k <every>] "
+             "[-r <ckptfile>] [<N>]\n");
+    MPI_Finalize();
+    return(1);
+  }
+
+  int n = 32;  	   	// mesh size
+  if (optind < argc) {  	// check command line for overwrite
+    if ((n = atoi(argv[optind])) < 3) {
+      if (rank == 0)
+        printf("Mesh size must be at least 3, got %s\n", argv[optind]);
+      MPI_Finalize();
+      return(1);
+    }
+  }
+
+  if (restart) {
+    if (!ckpt_read_header(restart, &hdr) ||
+        hdr.method == CKPT_GAUSS_SEIDEL) {
+      if (rank == 0)
+        printf("%s is not a Jacobi or red/black checkpoint\n", restart);
+      MPI_Finalize();
+      return(1);
+    }
+    n = hdr.n;
+  }
+
+  init_grid(&g, n);
+  if (n-2 < g.dims[0] || n-2 < g.dims[1]) {
+    if (g.rank == 0)
+      printf("Mesh size %d too small for a %d x %d process grid\n",
+             n, g.dims[0], g.dims[1]);
+    free_grid(&g);
+    MPI_Finalize();
+    return(1);
+  }
+
+  double (*a)[g.lc+2] = malloc(sizeof(double) * (g.lr+2) * (g.lc+2));
+
+  if (ckptfile || restart)
+    ckpt = ckpt_open(&g, ckptfile ? ckptfile : restart, every, n);
+
+  if (restart) {
+    init_array(&g, a);
+    ckpt_load(&g, ckpt, restart, a);
+    ckpt->method = hdr.method;
+    ckpt->start = hdr.iteration;
+    if (g.rank == 0)
+      printf("Resuming %s on %d x %d at iteration %d (delta=%6.4f)\n",
+             ckpt_method_name[hdr.method], n, n, hdr.iteration, hdr.delta);
+
+    if (hdr.delta <= EPSILON) {
+      if (g.rank == 0)
+        printf("Already converged\n");
+    }
+    else {
+      MPI_Barrier(g.comm);
+      begin = MPI_Wtime();
+      int cnt = (hdr.method == CKPT_JACOBI) ? jacobi(&g, a, EPSILON)
+                                            : red_black(&g, a, EPSILON);
+      end = MPI_Wtime();
+      if (g.rank == 0) {
+        printf("%s:\n", ckpt_method_name[hdr.method]);
+        printf("Mesh size: %d x %d, epsilon: %6.4f, iterations: %d\n",
+               n, n, EPSILON, cnt);
+        printf("Process grid: %d x %d, time: %f\n", g.dims[0], g.dims[1],
+               end - begin);
+      }
+      if (VERBOSE)
+        print_array(&g, n, a);
+    }
+
+    ckpt_close(&g, ckpt);
+    free(a);
+    free_grid(&g);
+    MPI_Finalize();
+    return 0;
+  }
+
+  // Jacobi iteration, return value is the total iteration number
+  init_array(&g, a);
+  MPI_Barrier(g.comm);
+  begin = MPI_Wtime();
+  int j_cnt = jacobi(&g, a, EPSILON);
+  end = MPI_Wtime();
+  if (g.rank == 0) {
+    printf("Jacobi:\n");
+    printf("Mesh size: %d x %d, epsilon=%6.4f, total Jacobi iterations: %d\n",
+           n, n, EPSILON, j_cnt);
+    printf("Process grid: %d x %d, time: %f\n", g.dims[0], g.dims[1],
+           end - begin);
+  }
+  if (VERBOSE)
+    print_array(&g, n, a);
+
+  // reinitialize the array
+  init_array(&g, a);
+  MPI_Barrier(g.comm);
+  begin = MPI_Wtime();
+  int rb_cnt = red_black(&g, a, EPSILON);
+  end = MPI_Wtime();
+  if (g.rank == 0) {
+    printf("Red/Black:\n");
+    printf("Mesh size: %d x %d, epsilon: %6.4f, iterations: %d\n",
+           n, n, EPSILON, rb_cnt);
+    printf("Process grid: %d x %d, time: %f\n", g.dims[0], g.dims[1],
+           end - begin);
+  }
+  if (VERBOSE)
+    print_array(&g, n, a);
+
+  if (ckpt)
+    ckpt_close(&g, ckpt);
+  free(a);
+  free_grid(&g);
+  MPI_Finalize();
+  return 0;
+}
@@ -13,72 +13,114 @@ config const epsilon = 0.001;	// convergence tolerance
 config const verbose = false; 	// printing control
 config const n = 8; 	        // mesh size (including boundary)
 
+// Compiling with -seltType=real(32) stores the mesh in single precision
+// while iterating, which halves the memory traffic of a sweep.  The
+// solve is then mixed-precision iterative refinement (solveRefined):
+// corrections are found in real(32) and applied to a real mesh, and
+// the residual is always computed in real.
+//
+config type eltType = real;	// mesh element type while iterating
+config const maxRefine = 10;	// refinement steps, at most
+
+// Source term of the correction equation at ij, or 0 when the solver
+// was called without one.
+//
+inline proc source(f, ij, type t) {
+  if f.type == nothing then return 0:t;
+  else return f(ij);
+}
 
-// Jacobi iteration -- return the iteration count.
+// One Jacobi sweep from x into xnew -- return the largest change.
+// The update and the convergence measure share a single pass.
+//
+proc jacobi_sweep(ID: domain(2), x: [] ?t, ref xnew: [] t, f) {
+  var delta: t;
+  forall ij in ID with (max reduce delta) do {
+    xnew(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
+                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4:t + source(f, ij, t);
+    delta reduce= abs(xnew(ij) - x(ij));
+  }
+  return delta;
+}
+
+// Jacobi iteration -- return the iteration count.  With a source term
+// f, every solver here solves x = avg(x) + f instead of x = avg(x).
+//
+// The two buffers are used in turn (x into xnew, then xnew back into x)
+// so no copy is needed between iterations.
 // 
-proc jacobi(D: domain(2), x: [D] real, epsilon: real) { 
+proc jacobi(D: domain(2), ref x: [D] ?t, epsilon: real, f = none) { 
   const ID = D.expand(-1,-1); 	// domain for interior points
-  var xnew: [D] real;           // buffer for new values
-  var delta: real; 		// measure of convergence 
+  var xnew: [D] t = x;          // second buffer, boundary copied once
+  var delta: t; 		// measure of convergence 
   var cnt = 0;			// iteration counter
 
   do {
-    forall ij in ID do
-      xnew(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                   + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
-    delta = max reduce abs(xnew[ID] - x[ID]);
-    x[ID] = xnew[ID];
-
+    delta = jacobi_sweep(ID, x, xnew, f);
     cnt += 1;
     if (verbose) {
       writeln("Iter: ", cnt, " (delta=", delta, ")\n");
-      writeln(x);
+      writeln(xnew);
+    }
+
+    if (delta > epsilon) {
+      delta = jacobi_sweep(ID, xnew, x, f);
+      cnt += 1;
+      if (verbose) {
+        writeln("Iter: ", cnt, " (delta=", delta, ")\n");
+        writeln(x);
+      }
+    }
+    else {
+      x[ID] = xnew[ID];         // converged into the second buffer
     }
   } while (delta > epsilon);
 
   return cnt;
 }
 
-proc gauss_seidel(D: domain(2), x: [D] real, epsilon: real) {
+// Gauss-Seidel iteration -- return the iteration count.
+//
+// The anti-diagonals i+j = d are swept in order.  Points on one diagonal
+// only read the previous diagonal (already updated) and the next one
+// (not yet updated), so each diagonal is a parallel loop and the sweep
+// gives exactly the sequential row-by-row result.
+//
+proc gauss_seidel(D: domain(2), ref x: [D] ?t, epsilon: real, f = none) {
   const ID = D.expand(-1, -1); //domain for interior points
+  const (rlo, clo) = ID.low;
+  const (rhi, chi) = ID.high;
+  var delta: t;                //measure of convergence
   var cnt = 0;                 //iteration counter
 
-  //boolean variables to check if delta < epsilon
-  //and if any one delta is > epsilon.  If any is >
-  //epsilon, need to keep calculating
-  var flag1: bool = false;
-  var flag2: bool = false;
-
   do {
-    //initialize on each iteration
-    flag1 = false;
-    flag2 = false;
+    delta = 0:t;
 
-    forall ij in ID with (ref flag1, ref flag2) do{ 
-      var temp: real = x(ij);
+    for d in (rlo+clo)..(rhi+chi) {
+      forall i in max(rlo, d-chi)..min(rhi, d-clo) with (max reduce delta) {
+        const j = d - i;
+        const temp = x(i,j);
 
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
+        x(i,j) = (x(i,j+1) + x(i,j-1) 
+                    + x(i+1,j) + x(i-1,j)) / 4:t + source(f, (i,j), t);
 
-      var my_delta = abs(x(ij) - temp);
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
+        delta reduce= abs(x(i,j) - temp);
       }
     }
 
     cnt += 1;
-
-  } while (!(flag1 && !flag2));
-  //to continue, flag1 must have been turned on and
-  //no one must have turned on flag2
+    if (verbose) {
+      writeln("Iter: ", cnt, " (delta=", delta, ")\n");
+      writeln(x);
+    }
+  } while (delta > epsilon);
 
   return cnt;
 }
 
-proc red_black(D: domain(2), x: [D] real, epsilon: real) {
+// Red/black iteration -- return the iteration count.
+//
+proc red_black(D: domain(2), ref x: [D] ?t, epsilon: real, f = none) {
   //even domains
   const E1 = {2..n-2 by 2, 2..n-2 by 2};
   const E2 = {1..n-2 by 2, 1..n-2 by 2};
@@ -87,87 +129,90 @@ proc red_black(D: domain(2), x: [D] real, epsilon: real) {
   const O1 = {2..n-2 by 2, 1..n-2 by 2};
   const O2 = {1..n-2 by 2, 2..n-2 by 2};
 
-  //counter
+  //measure of convergence and counter
+  var delta: t;
   var cnt = 0;
 
-  //flags to check if delta < epsilon and if any one delta > epsilon.
-  //If any is > epsilon, need to keep calculating
-  var flag1: bool;
-  var flag2: bool;
-
   do {
-    //initialize on each iteration
-    flag1 = false;
-    flag2 = false;
+    delta = 0:t;
 
-    forall ij in E1 with (ref flag1, ref flag2) do {
-      var temp: real = x(ij);
+    //red points, then black points; each color only reads the other
+    for C in (E1, E2, O1, O2) {
+      forall ij in C with (max reduce delta) do {
+        const temp = x(ij);
 
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
+        x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
+                   + x(ij+(1,0)) + x(ij+(-1,0))) / 4:t + source(f, ij, t);
 
-      var my_delta = abs(x(ij) - temp);
- 
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
+        delta reduce= abs(x(ij) - temp);
       }
     }
 
-    forall ij in E2 with (ref flag1, ref flag2) do{
-      var temp: real = x(ij);
-
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
-
-      var my_delta = abs(x(ij) - temp);
- 
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
-      }
+    cnt += 1;
+    if (verbose) {
+      writeln("Iter: ", cnt, " (delta=", delta, ")\n");
+      writeln(x);
     }
+  } while (delta > epsilon);
 
-    forall ij in O1 with (ref flag1, ref flag2) do {
-      var temp: real = x(ij);
-
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
-
-      var my_delta = abs(x(ij) - temp);
- 
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
-      }
-    }
+  return cnt;
+}
 
-    forall ij in O2 with (ref flag1, ref flag2) do {
-      var temp: real = x(ij);
+// Defect d = avg(x) - x of every interior point, in real -- return the
+// largest |d|, the residual.  d is left unchanged on the boundary.
+//
+proc defect(D: domain(2), x: [D] real, ref d: [D] real) {
+  const ID = D.expand(-1,-1);
+  var r: real;
+  forall ij in ID with (max reduce r) do {
+    d(ij) = (x(ij+(0,1)) + x(ij+(0,-1))
+             + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0 - x(ij);
+    r reduce= abs(d(ij));
+  }
+  return r;
+}
 
-      x(ij) = (x(ij+(0,1)) + x(ij+(0,-1)) 
-                 + x(ij+(1,0)) + x(ij+(-1,0))) / 4.0;
+// Run method on x, with the source term f if one is given -- return
+// the iteration count.
+//
+proc run(param method: string, D: domain(2), ref x, f = none) {
+  if method == "jacobi" then return jacobi(D, x, epsilon, f);
+  else if method == "gauss_seidel" then return gauss_seidel(D, x, epsilon, f);
+  else return red_black(D, x, epsilon, f);
+}
 
-      var my_delta = abs(x(ij) - temp);
- 
-      if (my_delta < epsilon){
-        flag1 = true;
-      }
-      else{
-        flag2 = true;
+// Solve x with method by mixed-precision iterative refinement -- return
+// the iterations, the refinement steps and the residual.
+//
+// Each step computes the defect d of x in real, solves e = avg(e) + d
+// with e = 0 on the boundary in eltType and adds e to x in real, until
+// the residual is at most epsilon.  With real storage the method runs
+// on x directly.
+//
+proc solveRefined(param method: string, D: domain(2), ref x: [D] real) {
+  const ID = D.expand(-1,-1);
+  var d: [D] real;
+  var cnt = 0, steps = 0;
+
+  if eltType == real then
+    cnt = run(method, D, x);
+  var r = defect(D, x, d);
+
+  if eltType != real {
+    var e, f: [D] eltType;
+    while r > epsilon && steps < maxRefine {
+      forall ij in D do {
+        f(ij) = d(ij): eltType;
+        e(ij) = 0: eltType;
       }
+      cnt += run(method, D, e, f);
+      forall ij in ID do
+        x(ij) += e(ij): real;
+      steps += 1;
+      r = defect(D, x, d);
     }
-
-  cnt += 1;
-
-  } while (!(flag1 && !flag2)); 
-  return cnt;
+  }
+  return (cnt, steps, r);
 }
 
 // Main routine.
@@ -175,12 +220,14 @@ proc red_black(D: domain(2), x: [D] real, epsilon: real) {
 proc main() {
   const D = {0..n-1, 0..n-1};   // domain including boundary points
   var a: [D] real = 0.0;	// mesh array
-  a[n-1, 0..n-1] = 1.0;         // - setting boundary values
+  a[n-1, 0..n-1] = 1.0;   // - setting boundary values
   a[0..n-1, n-1] = 1.0;
-  var cnt = jacobi(D, a, epsilon);
+  var (cnt, steps, res) = solveRefined("jacobi", D, a);
   writeln("Jacobi:");
   writeln("Mesh size: ", n, " x ", n, ", epsilon=", epsilon, 
             ", total Jacobi iterations: ", cnt);
+  writeln(eltType:string, " storage, refinement steps: ", steps,
+          ", residual: ", res);
 //  writeln(a);
   writeln("");
 
@@ -190,10 +237,13 @@ proc main() {
   a[0..n-1, n-1] = 1.0;
  
   //gauss-seidel method
-  var gs_cnt = gauss_seidel(D, a, epsilon);
+  var gs_cnt: int;
+  (gs_cnt, steps, res) = solveRefined("gauss_seidel", D, a);
   writeln("Gauss-Seidel:");
   writeln("Mesh size: ", n, " x ", n, ", epslon: ", epsilon, 
           ", Gauss-Seidel iterations: ", gs_cnt);
+  writeln(eltType:string, " storage, refinement steps: ", steps,
+          ", residual: ", res);
 //  writeln(a);
   writeln("");
 
@@ -203,10 +253,13 @@ proc main() {
   a[0..n-1, n-1] = 1.0;
 
   //red-black method
-  var rb_cnt = red_black(D, a, epsilon);
+  var rb_cnt: int;
+  (rb_cnt, steps, res) = solveRefined("red_black", D, a);
   writeln("Red-Black:");
   writeln("Mesh size: ", n, " x ", n, ", epsilon: ", epsilon, 
           ", iterations: ", rb_cnt);
+  writeln(eltType:string, " storage, refinement steps: ", steps,
+          ", residual: ", res);
 //  writeln(a);
   writeln("");
 
@@ -5,15 +5,49 @@
 
 // Jacobi method for solving a Laplace equation.  
 //
-// Usage: ./jacobi [N]
+// Usage: ./jacobi [-m <maskfile>] [-g <maskfile>] [-p <precision>]
+//                 [-c <ckptfile>] [-k <every>] [-r <ckptfile>] [N]
+//   -m  solve on the irregular domain in <maskfile> instead of the
+//       N x N square (see read_mask below)
+//   -g  write the N x N square problem as a mask file and exit
+//   -p  store the N x N mesh as double, float or half (if the compiler
+//       has _Float16) while iterating; float and half solve by mixed-
+//       precision iterative refinement, each correction found in the
+//       storage precision and applied in double (see solve_precision
+//       and laplace_lp.h), and the final residual is reported in double
+//   -c  checkpoint the double solvers to <ckptfile> every <every>
+//       iterations (default CKPT_EVERY) and when they converge, in the
+//       binary format of laplace_ckpt.h; the file is written by a
+//       background thread, so a solver only pays for copying the mesh
+//   -r  resume the method recorded in <ckptfile> from its mesh, which
+//       is mapped with mmap and iterated on in place; the resumed run
+//       keeps checkpointing to the same file unless -c is given
 // 
 //
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "laplace_ckpt.h"
 
 #define EPSILON 0.001 	// convergence tolerance
 #define VERBOSE 0 	// printing control
+#define MAXREFINE 10	// refinement steps, at most
+
+#define LP_T float
+#define LP_NAME(f) float_##f
+#include "laplace_lp.h"
+#ifdef __FLT16_MAX__
+#define LP_T _Float16
+#define LP_NAME(f) half_##f
+#include "laplace_lp.h"
+#endif
 
 // Initialize the mesh with a fixed set of boundary conditions.
 // 
@@ -40,12 +74,175 @@ void print_array(int n, double a[n][n])  {
   }
 }
 
+// Asynchronous checkpoint writer.  Every <every> iterations a solver
+// copies its mesh into the snapshot buffer and hands it to a
+// background thread, which writes it to <file>.tmp and renames that
+// over <file>, so the file always holds a complete mesh.  If the
+// previous write has not finished, the checkpoint is skipped rather
+// than stalling the solver; the last one of a solve is waited for.
+//
+typedef struct ckpt_ {
+  const char *file;
+  char *tmp;		// <file>.tmp
+  int n, every;
+  int method, start;	// method to resume and its iteration count
+  ckpt_header_t hdr;	// header of the snapshot
+  double *snap;		// snapshot of the mesh
+  int busy, quit;	// snapshot being written, writer to exit
+  int written, skipped;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} ckpt_t;
+
+ckpt_t *ckpt = NULL;	// checkpointing of the double solvers, if on
+
+// Write the snapshot; called by the writer thread without the lock.
+//
+void ckpt_write(ckpt_t *c) {
+  FILE *f = fopen(c->tmp, "wb");
+  long len = (long) c->n * c->n;
+
+  if (!f || fwrite(&c->hdr, sizeof(ckpt_header_t), 1, f) != 1 ||
+      fwrite(c->snap, sizeof(double), len, f) != (size_t) len ||
+      fflush(f) || fsync(fileno(f))) {
+    perror(c->tmp);
+    if (f)
+      fclose(f);
+    return;
+  }
+  fclose(f);
+  if (rename(c->tmp, c->file))
+    perror(c->file);
+}
+
+void *ckpt_writer(void *arg) {
+  ckpt_t *c = (ckpt_t *) arg;
+
+  pthread_mutex_lock(&c->lock);
+  for (;;) {
+    while (!c->busy && !c->quit)
+      pthread_cond_wait(&c->cond, &c->lock);
+    if (!c->busy)
+      break;
+    pthread_mutex_unlock(&c->lock);
+    ckpt_write(c);
+    pthread_mutex_lock(&c->lock);
+    c->busy = 0;
+    c->written++;
+    pthread_cond_broadcast(&c->cond);
+  }
+  pthread_mutex_unlock(&c->lock);
+  return NULL;
+}
+
+// Start checkpointing n x n meshes to <file>.
+//
+ckpt_t *ckpt_open(const char *file, int every, int n) {
+  ckpt_t *c = (ckpt_t *) calloc(1, sizeof(ckpt_t));
+
+  c->file = file;
+  c->tmp = (char *) malloc(strlen(file) + 5);
+  sprintf(c->tmp, "%s.tmp", file);
+  c->n = n;
+  c->every = every;
+  c->method = -1;
+  c->snap = (double *) malloc(sizeof(double) * n * n);
+  pthread_mutex_init(&c->lock, NULL);
+  pthread_cond_init(&c->cond, NULL);
+  pthread_create(&c->thread, NULL, ckpt_writer, c);
+  return c;
+}
+
+// Finish the pending write and stop the writer.
+//
+void ckpt_close(ckpt_t *c) {
+  pthread_mutex_lock(&c->lock);
+  c->quit = 1;
+  pthread_cond_signal(&c->cond);
+  pthread_mutex_unlock(&c->lock);
+  pthread_join(c->thread, NULL);
+
+  printf("Checkpoints: %d written to %s, %d skipped while busy\n",
+         c->written, c->file, c->skipped);
+  pthread_mutex_destroy(&c->lock);
+  pthread_cond_destroy(&c->cond);
+  free(c->snap);
+  free(c->tmp);
+  free(c);
+}
+
+// Iteration count a solver of <method> starts from: the resumed one
+// once, 0 otherwise.
+//
+int ckpt_start(int method) {
+  int start = 0;
+  if (ckpt && ckpt->method == method) {
+    start = ckpt->start;
+    ckpt->method = -1;
+  }
+  return start;
+}
+
+// Called by a solver after iteration cnt; checkpoints every <every>
+// iterations, and always (waiting for the write) if last.
+//
+void ckpt_step(int method, int n, double x[n][n], int cnt, double delta,
+               int last) {
+  if (!ckpt || (!last && cnt % ckpt->every))
+    return;
+
+  pthread_mutex_lock(&ckpt->lock);
+  if (ckpt->busy && !last) {
+    ckpt->skipped++;
+    pthread_mutex_unlock(&ckpt->lock);
+    return;
+  }
+  while (ckpt->busy)
+    pthread_cond_wait(&ckpt->cond, &ckpt->lock);
+  pthread_mutex_unlock(&ckpt->lock);
+
+  // the writer is idle until busy is set again
+  memcpy(ckpt->snap, x, sizeof(double) * n * n);
+  ckpt_fill_header(&ckpt->hdr, n, method, cnt, delta);
+
+  pthread_mutex_lock(&ckpt->lock);
+  ckpt->busy = 1;
+  pthread_cond_signal(&ckpt->cond);
+  while (last && ckpt->busy)
+    pthread_cond_wait(&ckpt->cond, &ckpt->lock);
+  pthread_mutex_unlock(&ckpt->lock);
+}
+
+// Map checkpoint <file> privately: the mesh can be iterated on in
+// place without changing the file.  Return the mapping (header first),
+// its length in *len.
+//
+void *ckpt_map(const char *file, size_t *len) {
+  int fd = open(file, O_RDONLY);
+  struct stat st;
+  void *map;
+
+  if (fd < 0 || fstat(fd, &st) || st.st_size < (off_t) sizeof(ckpt_header_t)) {
+    printf("Cannot read checkpoint %s\n", file);
+    exit(1);
+  }
+  map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED || !ckpt_valid((ckpt_header_t *) map, st.st_size)) {
+    printf("%s is not a valid checkpoint\n", file);
+    exit(1);
+  }
+  *len = st.st_size;
+  return map;
+}
+
 // Jacobi iteration -- return the iteration count.
 // 
 int jacobi(int n, double x[n][n], double epsilon) {
-  double xnew[n][n];	// buffer for new values    
+  double (*xnew)[n] = malloc(sizeof(double[n][n]));	// buffer for new values
   double delta;		// measure of convergence   
-  int cnt = 0;		// iteration counter              
+  int cnt = ckpt_start(CKPT_JACOBI);	// iteration counter
   int i, j;
 
   do {	
@@ -66,14 +263,16 @@ int jacobi(int n, double x[n][n], double epsilon) {
       printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
       print_array(n, x);
     }
+    ckpt_step(CKPT_JACOBI, n, x, cnt, delta, delta <= epsilon);
   } while (delta > epsilon);
+  free(xnew);
   return cnt;
 }
 
 //gauss_seidel version
 int gauss_seidel(int n, double x[n][n], double epsilon) {
   double delta, temp;
-  int cnt = 0;
+  int cnt = ckpt_start(CKPT_GAUSS_SEIDEL);
   int i, j;
 
   do {
@@ -90,13 +289,14 @@ int gauss_seidel(int n, double x[n][n], double epsilon) {
       printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
       print_array(n, x);
     }
+    ckpt_step(CKPT_GAUSS_SEIDEL, n, x, cnt, delta, delta <= epsilon);
   } while (delta > epsilon);
   return cnt;
 }
 
 int red_black(int n, double x[n][n], double epsilon) {
   double delta, delta_r, delta_b, temp_r, temp_b;
-  int cnt = 0;
+  int cnt = ckpt_start(CKPT_RED_BLACK);
   int i, j;
 
   do {
@@ -129,23 +329,502 @@ int red_black(int n, double x[n][n], double epsilon) {
       printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
       print_array(n, x);
     }
+    ckpt_step(CKPT_RED_BLACK, n, x, cnt, delta, delta <= epsilon);
+  } while (delta > epsilon);
+  return cnt;
+}
+
+// Defect d = avg(x) - x of every interior point, in double, with d = 0
+// on the boundary -- return the largest |d|, the residual.
+//
+double defect(int n, double x[n][n], double d[n][n]) {
+  double r = 0.0;
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      d[i][j] = 0.0;
+  for (int i = 1; i < n-1; i++)
+    for (int j = 1; j < n-1; j++) {
+      d[i][j] = (x[i-1][j] + x[i][j-1] + x[i+1][j] + x[i][j+1]) / 4.0
+                - x[i][j];
+      r = fmax(r, fabs(d[i][j]));
+    }
+  return r;
+}
+
+// Solve with every method in the given storage precision by mixed-
+// precision iterative refinement, and report the iterations, the
+// refinement steps and the residual.
+//
+// Each step computes the defect of the double mesh in double, solves
+// for its correction in the storage precision (laplace_lp.h) and adds
+// the correction in double, until the residual is at most EPSILON.
+// double storage runs the double solvers directly instead.
+//
+void solve_precision(int n, const char *prec) {
+  const char *name[3] = {"Jacobi", "Gauss-Seidel", "Red/Black"};
+  double (*a)[n] = malloc(sizeof(double[n][n]));
+  double (*d)[n] = malloc(sizeof(double[n][n]));
+
+  for (int m = 0; m < 3; m++) {
+    int cnt = 0, steps = 0;
+    double r;
+
+    init_array(n, a);
+    if (prec[0] == 'd') {
+      if (m == 0)
+        cnt = jacobi(n, a, EPSILON);
+      else if (m == 1)
+        cnt = gauss_seidel(n, a, EPSILON);
+      else
+        cnt = red_black(n, a, EPSILON);
+    }
+    while ((r = defect(n, a, d)) > EPSILON && prec[0] != 'd'
+           && steps < MAXREFINE) {
+      if (prec[0] == 'f')
+        cnt += float_solve(n, d, m, EPSILON);
+#ifdef __FLT16_MAX__
+      else
+        cnt += half_solve(n, d, m, EPSILON);
+#endif
+      for (int i = 1; i < n-1; i++)
+        for (int j = 1; j < n-1; j++)
+          a[i][j] += d[i][j];
+      steps++;
+    }
+
+    printf("%s (%s storage):\n", name[m], prec);
+    printf("Mesh size: %d x %d, epsilon: %6.4f, iterations: %d, "
+           "refinement steps: %d, residual: %.3e\n", n, n, EPSILON, cnt,
+           steps, r);
+    if (VERBOSE)
+      print_array(n, a);
+  }
+  free(a);
+  free(d);
+}
+
+// Sparse mesh for irregular domains.  Only in-domain cells are
+// stored: the live cells (solved for) and the fixed boundary cells.
+// Live cell k sits in mesh row r with row_ptr[r] <= k < row_ptr[r+1]
+// and column col[k]; its in-domain neighbours are
+// adj[adj_ptr[k]..adj_ptr[k+1]-1] (both in CSR form).  Values are
+// val[0..nlive-1] for live cells and val[nlive..] for fixed ones.
+//
+typedef struct sparse_ {
+  int rows, cols;
+  int nlive, nfixed;
+  int *row_ptr;		// live cells of each mesh row
+  int *col;		// mesh column of each live cell
+  int *adj_ptr;		// neighbour list of each live cell
+  int *adj;		// value index of each neighbour
+  double *val;		// live values, then fixed values
+  double *init;		// starting values of the live cells
+} sparse_t;
+
+// Make room for need elements of the given size in *p.
+//
+void grow(void *p, int *cap, int need, size_t size) {
+  if (need <= *cap)
+    return;
+  while (*cap < need)
+    *cap = *cap ? 2 * *cap : 1024;
+  *(void **) p = realloc(*(void **) p, *cap * size);
+}
+
+// Read a mask file:
+//   int rows, int cols, then for each row cols mask bytes followed by
+//   cols doubles.
+// Mask 0 is outside the domain, 1 a live cell starting at the given
+// value, 2 a fixed cell held at the given value.  A live cell becomes
+// the average of the neighbours that are in the domain.
+// The file is read a row at a time with a window of three rows of
+// cell ids, so memory grows with the domain, not the bounding box.
+//
+sparse_t *read_mask(const char *file) {
+  FILE *f = fopen(file, "rb");
+  int hdr[2];
+
+  if (!f || fread(hdr, sizeof(int), 2, f) != 2 || hdr[0] < 1 || hdr[1] < 1) {
+    printf("Cannot read mask file %s\n", file);
+    exit(1);
+  }
+
+  sparse_t *s = (sparse_t *) calloc(1, sizeof(sparse_t));
+  int rows = s->rows = hdr[0], cols = s->cols = hdr[1];
+  unsigned char *mask = (unsigned char *) malloc(cols);
+  double *v = (double *) malloc(sizeof(double) * cols);
+  double *fval = NULL;
+  int *id[3];		// cell ids of rows r-2, r-1 and r, by r % 3
+  int lcap = 0, ccap = 0, fcap = 0, acap = 0, pcap = 0, nadj = 0;
+
+  for (int w = 0; w < 3; w++)
+    id[w] = (int *) malloc(sizeof(int) * cols);
+  s->row_ptr = (int *) malloc(sizeof(int) * (rows + 1));
+
+  // read row r, then build the neighbour lists of row r-1
+  for (int r = 0; r <= rows; r++) {
+    if (r < rows) {
+      if (fread(mask, 1, cols, f) != (size_t) cols ||
+          fread(v, sizeof(double), cols, f) != (size_t) cols) {
+        printf("Mask file %s is short at row %d\n", file, r);
+        exit(1);
+      }
+      // ids: live k >= 0, fixed f as -(f+2), outside -1
+      s->row_ptr[r] = s->nlive;
+      for (int c = 0; c < cols; c++) {
+        if (mask[c] == 0)
+          id[r % 3][c] = -1;
+        else if (mask[c] == 1) {
+          grow(&s->init, &lcap, s->nlive + 1, sizeof(double));
+          grow(&s->col, &ccap, s->nlive + 1, sizeof(int));
+          s->init[s->nlive] = v[c];
+          s->col[s->nlive] = c;
+          id[r % 3][c] = s->nlive++;
+        }
+        else if (mask[c] == 2) {
+          grow(&fval, &fcap, s->nfixed + 1, sizeof(double));
+          fval[s->nfixed] = v[c];
+          id[r % 3][c] = -(s->nfixed++ + 2);
+        }
+        else {
+          printf("Bad mask value %d at row %d column %d\n", mask[c], r, c);
+          exit(1);
+        }
+      }
+    }
+    if (r == 0)
+      continue;
+
+    int *up = (r >= 2) ? id[(r - 2) % 3] : NULL;
+    int *mid = id[(r - 1) % 3];
+    int *down = (r < rows) ? id[r % 3] : NULL;
+    for (int c = 0; c < cols; c++) {
+      if (mid[c] < 0)
+        continue;
+      // same order as the dense stencil: up, left, down, right
+      int nb[4] = { up ? up[c] : -1, c > 0 ? mid[c-1] : -1,
+                    down ? down[c] : -1, c < cols-1 ? mid[c+1] : -1 };
+      grow(&s->adj_ptr, &pcap, mid[c] + 2, sizeof(int));
+      grow(&s->adj, &acap, nadj + 4, sizeof(int));
+      s->adj_ptr[mid[c]] = nadj;
+      for (int d = 0; d < 4; d++)
+        if (nb[d] != -1)
+          s->adj[nadj++] = nb[d];
+    }
+  }
+  s->row_ptr[rows] = s->nlive;
+  grow(&s->adj_ptr, &pcap, s->nlive + 1, sizeof(int));
+  s->adj_ptr[s->nlive] = nadj;
+
+  // fixed cells go after the live ones in val
+  for (int k = 0; k < nadj; k++)
+    if (s->adj[k] < 0)
+      s->adj[k] = s->nlive - s->adj[k] - 2;
+  s->val = (double *) malloc(sizeof(double) * (s->nlive + s->nfixed + 1));
+  if (s->nlive)
+    memcpy(s->val, s->init, sizeof(double) * s->nlive);
+  if (s->nfixed)
+    memcpy(s->val + s->nlive, fval, sizeof(double) * s->nfixed);
+
+  for (int w = 0; w < 3; w++)
+    free(id[w]);
+  free(mask);
+  free(v);
+  free(fval);
+  fclose(f);
+  return s;
+}
+
+// Write the n x n square problem of init_array() as a mask file.
+//
+void write_mask(const char *file, int n) {
+  double (*a)[n] = malloc(sizeof(double[n][n]));
+  unsigned char mask[n];
+  int hdr[2] = {n, n};
+  FILE *f = fopen(file, "wb");
+
+  if (!f) {
+    printf("Cannot write %s\n", file);
+    exit(1);
+  }
+  init_array(n, a);
+  fwrite(hdr, sizeof(int), 2, f);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++)
+      mask[j] = (i == 0 || j == 0 || i == n-1 || j == n-1) ? 2 : 1;
+    fwrite(mask, 1, n, f);
+    fwrite(a[i], sizeof(double), n, f);
+  }
+  fclose(f);
+  free(a);
+}
+
+// Restore the starting values of the live cells.
+//
+void reset_sparse(sparse_t *s) {
+  memcpy(s->val, s->init, sizeof(double) * s->nlive);
+}
+
+// Display the live cells, "." for everything else.
+//
+void print_sparse(sparse_t *s) {
+  for (int r = 0; r < s->rows; r++) {
+    int k = s->row_ptr[r];
+    for (int c = 0; c < s->cols; c++) {
+      if (k < s->row_ptr[r+1] && s->col[k] == c)
+        printf("%8.4f ", s->val[k++]);
+      else
+        printf("%8s ", ".");
+    }
+    printf("\n");
+  }
+}
+
+// New value of live cell k from the values in x.
+//
+static inline double sparse_avg(sparse_t *s, double *x, int k) {
+  int lo = s->adj_ptr[k], hi = s->adj_ptr[k+1];
+  double sum = 0.0;
+  if (lo == hi)
+    return x[k];	// isolated cell keeps its value
+  for (int e = lo; e < hi; e++)
+    sum += x[s->adj[e]];
+  return sum / (hi - lo);
+}
+
+// Jacobi iteration over the live cells -- return the iteration count.
+//
+int sparse_jacobi(sparse_t *s, double epsilon) {
+  int total = s->nlive + s->nfixed;
+  double *buf = (double *) malloc(sizeof(double) * (total + 1));
+  double *x = s->val, *xnew = buf, *tmp;
+  double delta;
+  int cnt = 0;
+
+  memcpy(buf, s->val, sizeof(double) * total);	// fixed values
+  do {
+    delta = 0.0;
+    for (int k = 0; k < s->nlive; k++) {
+      xnew[k] = sparse_avg(s, x, k);
+      delta = fmax(delta, fabs(xnew[k] - x[k]));
+    }
+    tmp = x; x = xnew; xnew = tmp;
+    cnt++;
+    if (VERBOSE)
+      printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
   } while (delta > epsilon);
+
+  if (x != s->val)
+    memcpy(s->val, x, sizeof(double) * s->nlive);
+  free(buf);
   return cnt;
 }
 
+// Gauss-Seidel over the live cells in row-major order.
+//
+int sparse_gauss_seidel(sparse_t *s, double epsilon) {
+  double delta, temp;
+  int cnt = 0;
+
+  do {
+    delta = 0.0;
+    for (int k = 0; k < s->nlive; k++) {
+      temp = s->val[k];
+      s->val[k] = sparse_avg(s, s->val, k);
+      delta = fmax(delta, fabs(s->val[k] - temp));
+    }
+    cnt++;
+    if (VERBOSE)
+      printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
+  } while (delta > epsilon);
+  return cnt;
+}
+
+// Red/black Gauss-Seidel over the live cells, colored by mesh position.
+//
+int sparse_red_black(sparse_t *s, double epsilon) {
+  double delta, temp;
+  int cnt = 0;
+
+  do {
+    delta = 0.0;
+    for (int color = 0; color < 2; color++) {
+      for (int r = 0; r < s->rows; r++) {
+        for (int k = s->row_ptr[r]; k < s->row_ptr[r+1]; k++) {
+          if ((r + s->col[k]) % 2 != color)
+            continue;
+          temp = s->val[k];
+          s->val[k] = sparse_avg(s, s->val, k);
+          delta = fmax(delta, fabs(s->val[k] - temp));
+        }
+      }
+    }
+    cnt++;
+    if (VERBOSE)
+      printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
+  } while (delta > epsilon);
+  return cnt;
+}
+
+void free_sparse(sparse_t *s) {
+  free(s->row_ptr);
+  free(s->col);
+  free(s->adj_ptr);
+  free(s->adj);
+  free(s->val);
+  free(s->init);
+  free(s);
+}
+
+// Solve on the domain in a mask file with all three methods.
+//
+void solve_mask(const char *file) {
+  sparse_t *s = read_mask(file);
+
+  printf("Mask %s: %d x %d, live cells: %d, fixed cells: %d\n",
+         file, s->rows, s->cols, s->nlive, s->nfixed);
+
+  int j_cnt = sparse_jacobi(s, EPSILON);
+  printf("Jacobi:\n");
+  printf("epsilon=%6.4f, total Jacobi iterations: %d\n", EPSILON, j_cnt);
+  if (VERBOSE)
+    print_sparse(s);
+
+  reset_sparse(s);
+  int gs_cnt = sparse_gauss_seidel(s, EPSILON);
+  printf("Gauss-Seidel:\n");
+  printf("epsilon: %6.4f, iterations: %d\n", EPSILON, gs_cnt);
+
+  reset_sparse(s);
+  int rb_cnt = sparse_red_black(s, EPSILON);
+  printf("Red/Black:\n");
+  printf("epsilon: %6.4f, iterations: %d\n", EPSILON, rb_cnt);
+
+  free_sparse(s);
+}
+
+// Resume the method recorded in checkpoint <file> and run it to
+// convergence.
+//
+void resume(const char *file, const char *ckptfile, int every) {
+  size_t len;
+  char *map = (char *) ckpt_map(file, &len);
+  ckpt_header_t *hdr = (ckpt_header_t *) map;
+  int n = hdr->n, m = hdr->method, cnt;
+  double (*a)[n] = (double (*)[n]) (map + sizeof(ckpt_header_t));
+
+  printf("Resuming %s on %d x %d at iteration %d (delta=%6.4f)\n",
+         ckpt_method_name[m], n, n, hdr->iteration, hdr->delta);
+  if (hdr->delta <= EPSILON) {
+    printf("Already converged\n");
+    munmap(map, len);
+    return;
+  }
+  ckpt = ckpt_open(ckptfile ? ckptfile : file, every, n);
+  ckpt->method = m;
+  ckpt->start = hdr->iteration;
+
+  if (m == CKPT_JACOBI)
+    cnt = jacobi(n, a, EPSILON);
+  else if (m == CKPT_GAUSS_SEIDEL)
+    cnt = gauss_seidel(n, a, EPSILON);
+  else
+    cnt = red_black(n, a, EPSILON);
+  printf("%s:\n", ckpt_method_name[m]);
+  printf("Mesh size: %d x %d, epsilon: %6.4f, iterations: %d\n",
+         n, n, EPSILON, cnt);
+  if (VERBOSE)
+    print_array(n, a);
+
+  ckpt_close(ckpt);
+  ckpt = NULL;
+  munmap(map, len);
+}
+
 // Main routine.
 //
 int main(int argc, char **argv) {
 
+  const char *maskfile = NULL, *genfile = NULL, *prec = NULL;
+  const char *ckptfile = NULL, *restart = NULL;
+  int every = CKPT_EVERY;
+  int opt;
+  while ((opt = getopt(argc, argv, "m:g:p:c:k:r:")) != -1) {
+    switch (opt) {
+    case 'm': maskfile = optarg; break;
+    case 'g': genfile = optarg; break;
+    case 'p': prec = optarg; break;
+    case 'c': ckptfile = optarg; break;
+    case 'k': every = atoi(optarg); break;
+    case 'r': restart = optarg; break;
+    default:
+      printf("Usage: ./jacobi [-m <maskfile>] [-g <maskfile>] "
+             "[-p <precision>]\n"
+             "                [-c <ckptfile>] [-k <every>] "
+             "[-r <ckptfile>] [N]\n");
+      exit(0);
+    }
+  }
+
+  if (every < 1) {
+    printf("<every> must be greater than 0\n");
+    exit(0);
+  }
+  if (restart) {
+    resume(restart, ckptfile, every);
+    return 0;
+  }
+
+  if (prec && strcmp(prec, "double") && strcmp(prec, "float")
+#ifdef __FLT16_MAX__
+      && strcmp(prec, "half")
+#endif
+     ) {
+#ifdef __FLT16_MAX__
+    printf("<precision> must be double, float or half\n");
+#else
+    printf("<precision> must be double or float\n");
+#endif
+    exit(0);
+  }
+
+  if (maskfile && prec) {
+    printf("-p applies to the N x N mesh only\n");
+    exit(0);
+  }
+  if (ckptfile && prec && strcmp(prec, "double")) {
+    printf("-c applies to the double solvers only\n");
+    exit(0);
+  }
+  if (maskfile) {
+    solve_mask(maskfile);
+    return 0;
+  }
+
   int n = 32;  	   	// mesh size, default 8 x 8
-  if (argc > 1) {  	// check command line for overwrite
-    if ((n = atoi(argv[1])) < 2) {
+  if (optind < argc) {  	// check command line for overwrite
+    if ((n = atoi(argv[optind])) < 2) {
       printf("Mesh size must must be greater than 2, use default\n");
       n = 8;
     }
   }
 
-  double a[n][n];	// mesh array
+  if (genfile) {
+    write_mask(genfile, n);
+    return 0;
+  }
+
+  if (ckptfile)
+    ckpt = ckpt_open(ckptfile, every, n);
+
+  if (prec) {
+    solve_precision(n, prec);
+    if (ckpt)
+      ckpt_close(ckpt);
+    return 0;
+  }
+
+  double (*a)[n] = malloc(sizeof(double[n][n]));	// mesh array
   init_array(n, a);
 
   // Jacobi iteration, return value is the total iteration number
@@ -177,4 +856,8 @@ int main(int argc, char **argv) {
           n, n, EPSILON, rb_cnt);
 
 //  print_array(n, a);
+
+  free(a);
+  if (ckpt)
+    ckpt_close(ckpt);
 }
@@ -0,0 +1,161 @@
+// Thread placement shared by the pthread and OpenMP programs.
+//
+// A policy maps thread k to a cpu:
+//   none       no pinning (default)
+//   compact    fill the cpus of one NUMA node before moving to the next
+//   scatter    deal threads round-robin over the NUMA nodes
+//   <list>     explicit cpu list such as 0,2,8-11; thread k gets entry
+//              k modulo the list length
+//
+// Only cpus in the process's starting affinity mask are used by compact
+// and scatter, so the policies compose with taskset/mpirun binding.
+// NUMA nodes are read from sysfs; without it every cpu is on node 0.
+//
+// Code must be compiled with _GNU_SOURCE defined.
+//
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define MAXNODES 64	// highest NUMA node id probed
+
+typedef struct affinity_ {
+  int ncpus;		// length of the cpu order (0 = no pinning)
+  int *cpu;		// cpu for thread k is cpu[k % ncpus]
+  int *node;		// NUMA node of cpu[k]
+  int nnodes;		// distinct nodes used
+} affinity_t;
+
+// NUMA node of a cpu from sysfs, 0 if unknown
+static inline int cpu_node(int cpu) {
+  char path[64];
+  for (int n = 0; n < MAXNODES; n++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d",
+             cpu, n);
+    if (access(path, F_OK) == 0)
+      return n;
+  }
+  return 0;
+}
+
+// Build the cpu order for <policy>.  Return 0, or -1 on a bad policy.
+//
+static inline int affinity_init(affinity_t *a, const char *policy) {
+  cpu_set_t mask;
+  int allowed[CPU_SETSIZE], nallowed = 0;
+
+  a->ncpus = 0;
+  a->nnodes = 1;
+  a->cpu = a->node = NULL;
+  if (!policy || strcmp(policy, "none") == 0)
+    return 0;
+
+  a->cpu = (int *) malloc(sizeof(int) * CPU_SETSIZE);
+  a->node = (int *) malloc(sizeof(int) * CPU_SETSIZE);
+
+  if (strcmp(policy, "compact") == 0 || strcmp(policy, "scatter") == 0) {
+    int node_of[CPU_SETSIZE], used[CPU_SETSIZE];
+    int maxnode = 0;
+
+    sched_getaffinity(0, sizeof(mask), &mask);
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+      if (CPU_ISSET(c, &mask)) {
+        node_of[nallowed] = cpu_node(c);
+        if (node_of[nallowed] > maxnode)
+          maxnode = node_of[nallowed];
+        used[nallowed] = 0;
+        allowed[nallowed++] = c;
+      }
+    }
+
+    // compact: node by node; scatter: one cpu from each node per round
+    while (a->ncpus < nallowed) {
+      for (int n = 0; n <= maxnode; n++) {
+        for (int i = 0; i < nallowed; i++) {
+          if (!used[i] && node_of[i] == n) {
+            used[i] = 1;
+            a->node[a->ncpus] = n;
+            a->cpu[a->ncpus++] = allowed[i];
+            if (policy[0] == 's')
+              break;
+          }
+        }
+      }
+    }
+  }
+  else {
+    const char *p = policy;
+    char *end;
+    while (*p) {
+      long lo = strtol(p, &end, 10), hi = lo;
+      if (end == p || lo < 0 || lo >= CPU_SETSIZE)
+        goto bad;
+      if (*end == '-') {
+        p = end + 1;
+        hi = strtol(p, &end, 10);
+        if (end == p || hi < lo || hi >= CPU_SETSIZE)
+          goto bad;
+      }
+      for (long c = lo; c <= hi && a->ncpus < CPU_SETSIZE; c++) {
+        a->node[a->ncpus] = cpu_node(c);
+        a->cpu[a->ncpus++] = c;
+      }
+      if (*end == ',')
+        end++;
+      else if (*end)
+        goto bad;
+      p = end;
+    }
+    if (a->ncpus == 0)
+      goto bad;
+  }
+
+  // count distinct nodes
+  a->nnodes = 0;
+  for (int i = 0; i < a->ncpus; i++) {
+    int seen = 0;
+    for (int j = 0; j < i; j++)
+      seen |= (a->node[j] == a->node[i]);
+    a->nnodes += !seen;
+  }
+  return 0;
+
+bad:
+  printf("Bad affinity policy %s (none, compact, scatter or a cpu list)\n",
+         policy);
+  free(a->cpu);
+  free(a->node);
+  a->cpu = a->node = NULL;
+  a->ncpus = 0;
+  return -1;
+}
+
+// NUMA node that thread k runs on under the policy (0 if not pinned)
+static inline int affinity_node(affinity_t *a, int k) {
+  return a->ncpus ? a->node[k % a->ncpus] : 0;
+}
+
+// Pin the calling thread as thread k.  Return its NUMA node.
+//
+static inline int affinity_pin(affinity_t *a, int k) {
+  cpu_set_t set;
+  if (a->ncpus == 0)
+    return 0;
+  CPU_ZERO(&set);
+  CPU_SET(a->cpu[k % a->ncpus], &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    printf("cannot pin thread %d to cpu %d\n", k, a->cpu[k % a->ncpus]);
+  return a->node[k % a->ncpus];
+}
+
+static inline void affinity_free(affinity_t *a) {
+  free(a->cpu);
+  free(a->node);
+}
+
+#endif
@@ -0,0 +1,49 @@
+// Order-independent checksum shared by the sorters' verifiers.
+//
+// Every element is hashed to 64 bits and the hashes are combined with
+// both a sum and an xor, neither of which depends on the order.  A sort
+// result must have the same checksum as its input, so elements that
+// were lost, duplicated or overwritten are caught even when the result
+// is in order.  Partial checksums of slices combine with checksum_merge
+// (or MPI_SUM / MPI_BXOR on the two fields).
+//
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+
+typedef struct checksum_ {
+  uint64_t sum;		// sum of the element hashes
+  uint64_t xr;		// xor of the element hashes
+} checksum_t;
+
+// splitmix64 finalizer: spreads every input bit over the hash
+static inline uint64_t hash64(uint64_t z) {
+  z += 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static inline void checksum_init(checksum_t *c) {
+  c->sum = c->xr = 0;
+}
+
+// add an element, given as up to 64 bits
+static inline void checksum_add(checksum_t *c, uint64_t bits) {
+  uint64_t h = hash64(bits);
+  c->sum += h;
+  c->xr ^= h;
+}
+
+// add the checksum of another slice to c
+static inline void checksum_merge(checksum_t *c, const checksum_t *d) {
+  c->sum += d->sum;
+  c->xr ^= d->xr;
+}
+
+static inline int checksum_equal(const checksum_t *a, const checksum_t *b) {
+  return a->sum == b->sum && a->xr == b->xr;
+}
+
+#endif
@@ -0,0 +1,64 @@
+//-------------------------------------------------------------------------
+// This is supporting software for CS415/515 Parallel Programming.
+// Copyright (c) Portland State University
+//-------------------------------------------------------------------------
+
+// Binary mesh / checkpoint format shared by 04_laplace.c and
+// 04_laplace-mpi.c.
+//
+// A file is a fixed 32-byte header followed by the whole n x n mesh,
+// boundary included, as doubles in row-major order.  The header says
+// which method produced the mesh, after how many iterations and with
+// what delta, so a run can be resumed by either program, with any
+// number of processes.  A converged run leaves its final mesh in the
+// same format.
+//
+#ifndef LAPLACE_CKPT_H
+#define LAPLACE_CKPT_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define CKPT_MAGIC "LAPMESH1"	// 8 bytes, no terminator in the file
+#define CKPT_EVERY 100		// default iterations between checkpoints
+
+enum { CKPT_JACOBI, CKPT_GAUSS_SEIDEL, CKPT_RED_BLACK, CKPT_NMETHOD };
+
+static const char *ckpt_method_name[CKPT_NMETHOD] = {
+  "Jacobi", "Gauss-Seidel", "Red/Black"
+};
+
+typedef struct ckpt_header_ {
+  char magic[8];
+  int32_t n;		// mesh size, including boundary
+  int32_t method;	// CKPT_JACOBI, ...
+  int32_t iteration;	// iterations done
+  int32_t reserved;
+  double delta;		// delta of the last iteration
+} ckpt_header_t;
+
+// Byte offset of mesh point (i, j).
+//
+static inline long ckpt_offset(int n, int i, int j) {
+  return (long) sizeof(ckpt_header_t) + ((long) i * n + j) * sizeof(double);
+}
+
+static inline void ckpt_fill_header(ckpt_header_t *h, int n, int method,
+                                    int iteration, double delta) {
+  memcpy(h->magic, CKPT_MAGIC, 8);
+  h->n = n;
+  h->method = method;
+  h->iteration = iteration;
+  h->reserved = 0;
+  h->delta = delta;
+}
+
+// Nonzero if h is a valid header for a file of <size> bytes.
+//
+static inline int ckpt_valid(const ckpt_header_t *h, long size) {
+  return memcmp(h->magic, CKPT_MAGIC, 8) == 0 && h->n >= 3 &&
+         h->method >= 0 && h->method < CKPT_NMETHOD && h->iteration >= 0 &&
+         size == ckpt_offset(h->n, h->n, 0);
+}
+
+#endif
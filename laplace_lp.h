@@ -0,0 +1,153 @@
+//-------------------------------------------------------------------------
+// This is supporting software for CS415/515 Parallel Programming.
+// Copyright (c) Portland State University
+//-------------------------------------------------------------------------
+
+// Reduced-precision versions of the dense solvers in 04_laplace.c.
+//
+// The mesh is stored in a narrower type than double, which halves (or
+// quarters) the memory traffic of a sweep and doubles the SIMD lanes.
+// The stencil sums and the convergence measure are always computed in
+// float, so half-precision storage does not lose more than its own
+// rounding.
+//
+// Each solve is one step of mixed-precision iterative refinement: the
+// caller computes the defect d = avg(x) - x of its double mesh x, and
+// the solvers here find the correction e with e = avg(e) + d and e = 0
+// on the boundary, which the caller adds to x in double.  Since e and d
+// shrink from step to step, their rounding shrinks with them.
+//
+// The file is a template: define the two macros below and include it
+// once per storage type.
+//   LP_T        storage type of the mesh, e.g. float or _Float16
+//   LP_NAME(f)  name of function f for this type, e.g. float_##f
+//
+#ifdef LP_T
+#define LP_(f) LP_NAME(f)
+
+// Round the double defect a into f and start the correction x at 0.
+//
+static void LP_(load)(int n, double a[n][n], LP_T f[n][n], LP_T x[n][n]) {
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) {
+      f[i][j] = (LP_T) a[i][j];
+      x[i][j] = (LP_T) 0;
+    }
+}
+
+// Widen the correction x back into the double mesh a.
+//
+static void LP_(store)(int n, LP_T x[n][n], double a[n][n]) {
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      a[i][j] = (double) x[i][j];
+}
+
+// New value of interior point (i, j), summed in float.
+//
+static inline float LP_(avg)(int n, LP_T x[n][n], LP_T f[n][n],
+                             int i, int j) {
+  return ((float) x[i-1][j] + (float) x[i][j-1]
+          + (float) x[i+1][j] + (float) x[i][j+1]) / 4.0f + (float) f[i][j];
+}
+
+// Jacobi iteration -- return the iteration count.
+//
+static int LP_(jacobi)(int n, LP_T x[n][n], LP_T f[n][n], float epsilon) {
+  LP_T (*xnew)[n] = malloc(sizeof(LP_T[n][n]));	// buffer for new values
+  float delta;
+  int cnt = 0;
+
+  do {
+    delta = 0.0f;
+    for (int i = 1; i < n-1; i++) {
+      for (int j = 1; j < n-1; j++) {
+	xnew[i][j] = (LP_T) LP_(avg)(n, x, f, i, j);
+	delta = fmaxf(delta, fabsf((float) xnew[i][j] - (float) x[i][j]));
+      }
+    }
+    for (int i = 1; i < n-1; i++)
+      for (int j = 1; j < n-1; j++)
+	x[i][j] = xnew[i][j];
+    cnt++;
+    if (VERBOSE)
+      printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
+  } while (delta > epsilon);
+  free(xnew);
+  return cnt;
+}
+
+// Gauss-Seidel iteration -- return the iteration count.
+//
+static int LP_(gauss_seidel)(int n, LP_T x[n][n], LP_T f[n][n],
+                              float epsilon) {
+  float delta, temp;
+  int cnt = 0;
+
+  do {
+    delta = 0.0f;
+    for (int i = 1; i < n-1; i++) {
+      for (int j = 1; j < n-1; j++) {
+        temp = (float) x[i][j];
+        x[i][j] = (LP_T) LP_(avg)(n, x, f, i, j);
+	delta = fmaxf(delta, fabsf((float) x[i][j] - temp));
+      }
+    }
+    cnt++;
+    if (VERBOSE)
+      printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
+  } while (delta > epsilon);
+  return cnt;
+}
+
+// Red/black Gauss-Seidel -- return the iteration count.
+//
+static int LP_(red_black)(int n, LP_T x[n][n], LP_T f[n][n],
+                           float epsilon) {
+  float delta, temp;
+  int cnt = 0;
+
+  do {
+    delta = 0.0f;
+    for (int color = 0; color < 2; color++) {
+      for (int i = 1; i < n-1; i++) {
+        for (int j = 1 + (i + 1 + color) % 2; j < n-1; j += 2) {
+          temp = (float) x[i][j];
+          x[i][j] = (LP_T) LP_(avg)(n, x, f, i, j);
+	  delta = fmaxf(delta, fabsf((float) x[i][j] - temp));
+        }
+      }
+    }
+    cnt++;
+    if (VERBOSE)
+      printf("Iter %d: (delta=%6.4f)\n", cnt, delta);
+  } while (delta > epsilon);
+  return cnt;
+}
+
+// Solve for the correction to the defect a with method m (0 Jacobi,
+// 1 Gauss-Seidel, 2 red/black) in this precision and leave it in a --
+// return the iteration count.
+//
+static int LP_(solve)(int n, double a[n][n], int m, double epsilon) {
+  LP_T (*x)[n] = malloc(sizeof(LP_T[n][n]));
+  LP_T (*f)[n] = malloc(sizeof(LP_T[n][n]));
+  int cnt;
+
+  LP_(load)(n, a, f, x);
+  if (m == 0)
+    cnt = LP_(jacobi)(n, x, f, (float) epsilon);
+  else if (m == 1)
+    cnt = LP_(gauss_seidel)(n, x, f, (float) epsilon);
+  else
+    cnt = LP_(red_black)(n, x, f, (float) epsilon);
+  LP_(store)(n, x, a);
+  free(x);
+  free(f);
+  return cnt;
+}
+
+#undef LP_
+#undef LP_T
+#undef LP_NAME
+#endif
@@ -0,0 +1,287 @@
+// Parallel stable merge sort, shared by the pthread and OpenMP sorters.
+//
+// All P threads call <name>_parallel() together:
+//   1. each thread merge-sorts its own contiguous run of the array;
+//   2. while there are more than MSORT_FANIN runs, neighbouring runs are
+//      merged in pairs; every thread produces an equal slice of the
+//      output, located in the inputs with a merge-path (co-rank) search;
+//   3. the remaining runs are merged in one k-way pass: each thread
+//      finds where its output slice starts in every run and merges its
+//      slice with a loser tree.
+// Ties always go to the earlier run, so the sort is stable and takes
+// O(N log N) time whatever the input order.
+//
+// The file is a template: define the three macros below and include it
+// once per element type.
+//   MSORT_T        element type
+//   MSORT_KEY(e)   int sort key of element e
+//   MSORT_NAME(f)  name of function f for this type, e.g. int_##f
+//
+// The threads synchronize through a caller-supplied barrier function,
+// so the same code runs under pthreads and OpenMP.
+//
+// Included without MSORT_T, it only declares record_t and
+// msort_barrier_t.
+//
+#ifndef MSORT_H
+#define MSORT_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define MSORT_CUTOFF 16		// runs shorter than this use insertion sort
+#define MSORT_FANIN 8		// runs left for the final k-way merge
+
+// key + payload record for stable (multi-key) sorting
+typedef struct record_ {
+  int key;
+  int payload;
+} record_t;
+
+// barrier across all threads taking part in the sort
+typedef void (*msort_barrier_t)(void *arg);
+
+#endif
+
+#ifdef MSORT_T
+#define MS_(f) MSORT_NAME(f)
+
+// Stable insertion sort of a[0..n-1].
+//
+static void MS_(insertion)(MSORT_T *a, long n) {
+  for (long i = 1; i < n; i++) {
+    MSORT_T e = a[i];
+    long j = i;
+    while (j > 0 && MSORT_KEY(a[j-1]) > MSORT_KEY(e)) {
+      a[j] = a[j-1];
+      j--;
+    }
+    a[j] = e;
+  }
+}
+
+// Stable merge of a[0..na-1] and b[0..nb-1] into out.
+//
+static void MS_(merge)(const MSORT_T *a, long na, const MSORT_T *b, long nb,
+                       MSORT_T *out) {
+  long i = 0, j = 0, k = 0;
+  while (i < na && j < nb)
+    out[k++] = (MSORT_KEY(b[j]) < MSORT_KEY(a[i])) ? b[j++] : a[i++];
+  while (i < na)
+    out[k++] = a[i++];
+  while (j < nb)
+    out[k++] = b[j++];
+}
+
+// Sequential stable merge sort of a[0..n-1], tmp[0..n-1] is scratch.
+//
+static void MS_(sort_run)(MSORT_T *a, MSORT_T *tmp, long n) {
+  MSORT_T *src = a, *dst = tmp, *swp;
+
+  for (long i = 0; i < n; i += MSORT_CUTOFF)
+    MS_(insertion)(a + i, n - i < MSORT_CUTOFF ? n - i : MSORT_CUTOFF);
+
+  for (long w = MSORT_CUTOFF; w < n; w *= 2) {
+    for (long i = 0; i < n; i += 2*w) {
+      long m = i + w < n ? i + w : n;
+      long e = i + 2*w < n ? i + 2*w : n;
+      MS_(merge)(src + i, m - i, src + m, e - m, dst + i);
+    }
+    swp = src; src = dst; dst = swp;
+  }
+  if (src != a)
+    memcpy(a, src, sizeof(MSORT_T) * n);
+}
+
+// Merge path: how many of the first k elements of the stable merge of
+// a and b come from a.
+//
+static long MS_(corank)(long k, const MSORT_T *a, long na,
+                        const MSORT_T *b, long nb) {
+  long lo = k > nb ? k - nb : 0;
+  long hi = k < na ? k : na;
+  while (lo < hi) {
+    long i = lo + (hi - lo) / 2, j = k - i;
+    if (j > 0 && i < na && MSORT_KEY(a[i]) <= MSORT_KEY(b[j-1]))
+      lo = i + 1;
+    else
+      hi = i;
+  }
+  return lo;
+}
+
+// first index in a[0..n-1] with key >= v (upper: key > v)
+static long MS_(lower_bound)(const MSORT_T *a, long n, long v, int upper) {
+  long lo = 0, hi = n;
+  while (lo < hi) {
+    long m = lo + (hi - lo) / 2;
+    if (MSORT_KEY(a[m]) < v || (upper && MSORT_KEY(a[m]) == v))
+      lo = m + 1;
+    else
+      hi = m;
+  }
+  return lo;
+}
+
+// Co-rank for nr runs: set pos[r] so that the first k elements of the
+// stable k-way merge are exactly the prefixes run[r][0..pos[r]-1].
+// The k-th key is found by bisecting the key range; equal keys are
+// handed out in run order.
+//
+static void MS_(multi_corank)(long k, MSORT_T **run, long *len, int nr,
+                              long *pos) {
+  long lo = INT_MIN, hi = INT_MAX;
+
+  while (lo < hi) {
+    long v = lo + (hi - lo) / 2, c = 0;
+    for (int r = 0; r < nr; r++)
+      c += MS_(lower_bound)(run[r], len[r], v, 1);
+    if (c >= k)
+      hi = v;
+    else
+      lo = v + 1;
+  }
+
+  long left = k;
+  for (int r = 0; r < nr; r++) {
+    pos[r] = MS_(lower_bound)(run[r], len[r], lo, 0);
+    left -= pos[r];
+  }
+  for (int r = 0; r < nr && left > 0; r++) {
+    long eq = MS_(lower_bound)(run[r], len[r], lo, 1) - pos[r];
+    long take = eq < left ? eq : left;
+    pos[r] += take;
+    left -= take;
+  }
+}
+
+// Does leaf i of the loser tree beat leaf j?  Exhausted runs lose,
+// ties go to the earlier run.
+//
+static inline int MS_(beats)(MSORT_T **run, long *cur, long *end,
+                             int i, int j) {
+  if (cur[i] >= end[i])
+    return 0;
+  if (cur[j] >= end[j])
+    return 1;
+  int ki = MSORT_KEY(run[i][cur[i]]), kj = MSORT_KEY(run[j][cur[j]]);
+  return ki < kj || (ki == kj && i < j);
+}
+
+// Loser-tree merge of run[r][from[r]..to[r]-1], r = 0..nr-1, into out.
+//
+static void MS_(ktree_merge)(MSORT_T **run, long *from, long *to, int nr,
+                             MSORT_T *out) {
+  int K = 1;
+  while (K < nr)
+    K *= 2;
+
+  MSORT_T *leaf[K];
+  long cur[K], end[K];
+  int loser[K], win[2*K];
+  long total = 0;
+
+  for (int i = 0; i < K; i++) {
+    leaf[i] = i < nr ? run[i] : NULL;
+    cur[i] = i < nr ? from[i] : 0;
+    end[i] = i < nr ? to[i] : 0;
+    if (i < nr)
+      total += to[i] - from[i];
+    win[K + i] = i;
+  }
+
+  // initial tournament: internal node keeps the loser, passes the winner
+  for (int node = K - 1; node >= 1; node--) {
+    int a = win[2*node], b = win[2*node + 1];
+    if (MS_(beats)(leaf, cur, end, a, b)) {
+      win[node] = a;
+      loser[node] = b;
+    }
+    else {
+      win[node] = b;
+      loser[node] = a;
+    }
+  }
+
+  int w = win[1];
+  for (long k = 0; k < total; k++) {
+    out[k] = leaf[w][cur[w]++];
+    // replay from the winner's leaf to the root
+    for (int node = (w + K) / 2; node >= 1; node /= 2) {
+      if (MS_(beats)(leaf, cur, end, loser[node], w)) {
+        int t = loser[node];
+        loser[node] = w;
+        w = t;
+      }
+    }
+  }
+}
+
+// Parallel stable merge sort of a[0..n-1] with scratch tmp[0..n-1].
+// Called by every thread tid = 0..P-1; barrier(arg) must wait for all
+// P threads.
+//
+static void MS_(parallel)(MSORT_T *a, MSORT_T *tmp, long n, int tid, int P,
+                          msort_barrier_t barrier, void *arg) {
+  long bounds[P+1];
+  long k0 = n * tid / P, k1 = n * (tid + 1) / P;	// my output slice
+  MSORT_T *src = a, *dst = tmp, *swp;
+  int runs = P;
+
+  for (int t = 0; t <= P; t++)
+    bounds[t] = n * t / P;
+
+  // 1. sort my own run
+  MS_(sort_run)(a + k0, tmp + k0, k1 - k0);
+  barrier(arg);
+
+  // 2. pairwise merge-path rounds down to the loser-tree fan-in
+  while (runs > MSORT_FANIN) {
+    int nr = 0;
+    for (int r = 0; r < runs; r += 2) {
+      long lo = bounds[r], mid = bounds[r+1];
+      long hi = r + 2 <= runs ? bounds[r+2] : mid;
+      long s0 = k0 > lo ? k0 : lo, s1 = k1 < hi ? k1 : hi;
+      if (s0 < s1) {
+        long i0 = MS_(corank)(s0 - lo, src + lo, mid - lo, src + mid, hi - mid);
+        long i1 = MS_(corank)(s1 - lo, src + lo, mid - lo, src + mid, hi - mid);
+        MS_(merge)(src + lo + i0, i1 - i0,
+                   src + mid + (s0 - lo - i0), (s1 - lo - i1) - (s0 - lo - i0),
+                   dst + s0);
+      }
+      bounds[nr++] = lo;
+    }
+    bounds[nr] = n;
+    runs = nr;
+    swp = src; src = dst; dst = swp;
+    barrier(arg);
+  }
+
+  // 3. final k-way merge of my output slice
+  if (runs > 1) {
+    MSORT_T *run[runs];
+    long len[runs], from[runs], to[runs];
+    for (int r = 0; r < runs; r++) {
+      run[r] = src + bounds[r];
+      len[r] = bounds[r+1] - bounds[r];
+    }
+    MS_(multi_corank)(k0, run, len, runs, from);
+    MS_(multi_corank)(k1, run, len, runs, to);
+    MS_(ktree_merge)(run, from, to, runs, dst + k0);
+    swp = src; src = dst; dst = swp;
+    barrier(arg);
+  }
+
+  // 4. leave the result in a
+  if (src != a) {
+    memcpy(a + k0, src + k0, sizeof(MSORT_T) * (k1 - k0));
+    barrier(arg);
+  }
+}
+
+#undef MS_
+#undef MSORT_T
+#undef MSORT_KEY
+#undef MSORT_NAME
+#endif
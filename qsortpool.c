@@ -0,0 +1,665 @@
+//Persistent pthread sorting pool, see qsortpool.h.
+//
+//All jobs share one task queue.  A quicksort job starts as one task
+//for its whole range; a worker partitions a range, queues the left
+//part as a new task and carries on with the right part; parts that
+//hold none of the job's requested ranks are dropped.  A merge job
+//queues one task per worker (its thread index); since those tasks are
+//queued together and a worker holding one blocks in the job's barrier,
+//each of them is taken by a different worker.  A job counts its
+//progress under its own lock and signals its waiters when done.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <stdint.h>
+#include "affinity.h"
+#include "qsortpool.h"
+
+//parallel merge sort for int arrays and key+payload records
+#define MSORT_T int
+#define MSORT_KEY(e) (e)
+#define MSORT_NAME(f) int_##f
+#include "msort.h"
+#define MSORT_T record_t
+#define MSORT_KEY(e) ((e).key)
+#define MSORT_NAME(f) rec_##f
+#include "msort.h"
+
+//threshhold for switching to bubble sort
+#define MINSIZE 10
+
+//queued tasks a worker looks through for one on its own NUMA node
+#define LOCAL_SCAN 8
+
+//job kind used by qsort_pool_touch
+#define QSORT_TOUCH (-1)
+
+
+
+//----------------------------------------------------------------------
+//Task and queue representaions
+typedef struct task_ {
+  qsort_job_t *job;
+  int low;		//range to sort, or thread index of a merge task
+  int high;
+  struct task_ *next;
+} task_t;
+
+typedef struct queue_{
+  task_t *head;
+  task_t *tail;
+  int length;
+} queue_t;
+
+//create a new task
+task_t *create_task(qsort_job_t *job, int low, int high){
+  task_t *task = (task_t *) malloc(sizeof(task_t));
+  task->job = job;
+  task->low = low;
+  task->high = high;
+  task->next = NULL;
+  return task;
+}
+
+//add a task to tail of queue
+void add_task(queue_t *queue, task_t *task){
+  if(!queue->tail){
+    queue->head = queue->tail = task;
+  }
+  else{
+    queue->tail->next = task;
+    queue->tail = task;
+  }
+
+  queue->length++;
+}
+
+//remove a task from the head of the queue (return NULL if empty)
+task_t *remove_task(queue_t *queue){
+  task_t *task = NULL;
+
+  if(queue->length > 0){
+    task = queue->head;
+
+    if(queue->head == queue->tail){
+      queue->head = queue->tail = NULL;
+    }
+    else{
+      queue->head = queue->head->next;
+    }
+
+    queue->length--;
+  }
+
+  return task;
+}
+//-------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------
+//Per-thread trace counters, compiled in with -DTRACE
+#ifdef TRACE
+#define TRACE_SAMPLES 4096	//queue-depth samples kept per thread
+
+typedef struct trace_ {
+  int cpu;
+  long tasks;			//tasks taken from the queue
+  long partitions;		//calls to partition()
+  long scanned;			//elements scanned by partition()
+  long sorted;			//elements put in final position
+  uint64_t begin, end;		//worker lifetime
+  uint64_t t_partition;		//time in partition()
+  uint64_t t_wait;		//time blocked on length_cond
+  uint64_t t_acquire;		//time acquiring queue_lock
+  uint64_t t_hold;		//time holding queue_lock
+  uint64_t lock_start;		//when queue_lock was last acquired
+  int nsamples, stride, skip;	//queue-depth sampling state
+  uint64_t sample_t[TRACE_SAMPLES];
+  int sample_depth[TRACE_SAMPLES];
+} __attribute__((aligned(64))) trace_t;
+
+__thread trace_t *my_trace = NULL;
+
+//monotonic time in nanoseconds
+static inline uint64_t trace_now(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//record the queue length; when the buffer fills up, keep every other
+//sample and halve the sampling rate from then on
+static inline void trace_depth(int depth){
+  trace_t *t = my_trace;
+  if(++t->skip < t->stride){
+    return;
+  }
+  t->skip = 0;
+  if(t->nsamples == TRACE_SAMPLES){
+    for(int i = 0; i < TRACE_SAMPLES/2; i++){
+      t->sample_t[i] = t->sample_t[2*i];
+      t->sample_depth[i] = t->sample_depth[2*i];
+    }
+    t->nsamples = TRACE_SAMPLES/2;
+    t->stride *= 2;
+  }
+  t->sample_t[t->nsamples] = trace_now();
+  t->sample_depth[t->nsamples] = depth;
+  t->nsamples++;
+}
+
+//write all threads' counters as a Chrome trace
+void trace_dump(trace_t *traces, int num_thread, uint64_t trace_epoch){
+  const char *name = getenv("QSORT_TRACE");
+  FILE *f = fopen(name ? name : "qsort_trace.json", "w");
+  if(!f){
+    printf("cannot write trace file\n");
+    return;
+  }
+
+  fprintf(f, "{\"traceEvents\":[\n");
+  for(int k = 0; k < num_thread; k++){
+    trace_t *t = &traces[k];
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+               "\"tid\":%d,\"args\":{\"name\":\"worker %d (cpu %d)\"}},\n",
+            k, k, t->cpu);
+    fprintf(f, "{\"name\":\"worker\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+               "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"tasks\":%ld,"
+               "\"partitions\":%ld,\"scanned\":%ld,\"sorted\":%ld,"
+               "\"partition_us\":%.3f,\"cond_wait_us\":%.3f,"
+               "\"lock_acquire_us\":%.3f,\"lock_hold_us\":%.3f}},\n",
+            k, (t->begin - trace_epoch) / 1e3, (t->end - t->begin) / 1e3,
+            t->tasks, t->partitions, t->scanned, t->sorted,
+            t->t_partition / 1e3, t->t_wait / 1e3,
+            t->t_acquire / 1e3, t->t_hold / 1e3);
+    for(int i = 0; i < t->nsamples; i++){
+      fprintf(f, "{\"name\":\"queue depth\",\"ph\":\"C\",\"pid\":0,"
+                 "\"tid\":%d,\"ts\":%.3f,\"args\":{\"depth\":%d}},\n",
+              k, (t->sample_t[i] - trace_epoch) / 1e3, t->sample_depth[i]);
+    }
+  }
+  fprintf(f, "{}]}\n");
+  fclose(f);
+}
+
+#define TRACE_ADD(field, v) (my_trace->field += (v))
+#define TRACE_TIME(v) uint64_t v = trace_now()
+#define TRACE_SINCE(field, v) (my_trace->field += trace_now() - (v))
+#else
+#define TRACE_ADD(field, v)
+#define TRACE_TIME(v)
+#define TRACE_SINCE(field, v)
+#endif
+//----------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------
+//Pool and job state
+struct qsort_pool_ {
+  int num_thread;
+  affinity_t affinity;
+  pthread_t *threads;
+  void *args;			//worker arguments
+  queue_t queue;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t length_cond;	//queue not empty, or shutting down
+  int shutdown;
+#ifdef TRACE
+  trace_t *traces;		//one per thread
+  uint64_t trace_epoch;
+#endif
+};
+
+struct qsort_job_ {
+  qsort_pool_t *pool;
+  int mode;
+  void *data;
+  int n;
+  void *scratch;		//merge buffer
+  pthread_barrier_t barrier;	//merge workers
+  pthread_mutex_t lock;		//count and done
+  pthread_cond_t done_cond;
+  int rlo, rhi;			//ranks to put in place (quicksort)
+  long count;			//ranks in final position, or merge
+  long target;			//workers finished; done at target
+  int done;
+};
+
+//worker thread argument
+typedef struct worker_arg_ {
+  qsort_pool_t *pool;
+  long wid;
+} worker_arg_t;
+
+//acquire, release and wait on the queue lock
+//(these only do extra work when tracing)
+static inline void lock_queue(qsort_pool_t *pool){
+  TRACE_TIME(t);
+  pthread_mutex_lock(&pool->queue_lock);
+  TRACE_SINCE(t_acquire, t);
+#ifdef TRACE
+  my_trace->lock_start = trace_now();
+#endif
+}
+
+static inline void unlock_queue(qsort_pool_t *pool){
+  TRACE_SINCE(t_hold, my_trace->lock_start);
+  pthread_mutex_unlock(&pool->queue_lock);
+}
+
+static inline void wait_queue(qsort_pool_t *pool){
+  TRACE_SINCE(t_hold, my_trace->lock_start);
+  TRACE_TIME(t);
+  pthread_cond_wait(&pool->length_cond, &pool->queue_lock);
+  TRACE_SINCE(t_wait, t);
+#ifdef TRACE
+  my_trace->lock_start = trace_now();
+#endif
+}
+
+//queue a task and wake one sleeping worker (called by workers, so the
+//lock is traced)
+static void push_task(qsort_pool_t *pool, task_t *task){
+  lock_queue(pool);
+  add_task(&pool->queue, task);
+  pthread_cond_signal(&pool->length_cond);
+  unlock_queue(pool);
+}
+
+//count progress on a job, wake its waiters when it is complete
+static void job_progress(qsort_job_t *job, long k){
+  pthread_mutex_lock(&job->lock);
+  job->count += k;
+  if(job->count >= job->target){
+    job->done = 1;
+    pthread_cond_broadcast(&job->done_cond);
+  }
+  pthread_mutex_unlock(&job->lock);
+}
+
+//NUMA node whose worker first touched element i of a job's array
+static inline int home_node(qsort_job_t *job, int i){
+  qsort_pool_t *pool = job->pool;
+  return affinity_node(&pool->affinity,
+                       (int) ((long) i * pool->num_thread / job->n));
+}
+
+//remove the first of the next LOCAL_SCAN quicksort tasks whose range
+//starts on <node>, or the head of the queue if none does (NULL if
+//empty).  Merge tasks must be taken in queue order, so the scan stops
+//at the first one.
+task_t *remove_local_task(queue_t *queue, int node){
+  task_t *prev = NULL, *task = queue->head;
+
+  for(int i = 0; i < LOCAL_SCAN && task; i++){
+    if(task->job->mode != QSORT_QUICK){
+      break;
+    }
+    if(home_node(task->job, task->low) == node){
+      if(!prev){
+        return remove_task(queue);
+      }
+      prev->next = task->next;
+      if(queue->tail == task){
+        queue->tail = prev;
+      }
+      queue->length--;
+      return task;
+    }
+    prev = task;
+    task = task->next;
+  }
+
+  return remove_task(queue);
+}
+//----------------------------------------------------------------------
+
+
+
+//swap 2 elements of an array
+void swap(int *array, int i, int j){
+  if (i == j){
+    return;
+  }
+
+  int temp = array[i];
+  array[i] = array[j];
+  array[j] = temp;
+}
+
+//bubble sort for the base cases
+void bubblesort(int *array, int low, int high){
+  if(low >= high){
+    return;
+  }
+
+  for(int i = low; i <= high; i++){
+    for(int j = i+1; j <= high; j++){
+      if(array[i] > array[j]){
+        swap(array, i, j);
+      }
+    }
+  }
+}
+
+//index of the median of array[a], array[b] and array[c]
+static inline int median3(int *array, int a, int b, int c){
+  if(array[a] < array[b]){
+    return array[b] < array[c] ? b : (array[a] < array[c] ? c : a);
+  }
+  return array[a] < array[c] ? a : (array[b] < array[c] ? c : b);
+}
+
+//pick the pivot as the median of three medians of three (Tukey's
+//ninther) spread over the range, so sorted, reverse and organpipe
+//input do not make it an extreme
+//rearrange array elements into [smaller elements, copies of pivot,
+//larger elements] and return the range of the copies in [*lt, *gt],
+//so runs of equal keys are not partitioned again
+void partition(int *array, int low, int high, int *lt, int *gt){
+  int mid = low + (high - low) / 2, s = (high - low) / 8;
+  int pivot = array[median3(array,
+                            median3(array, low, low + s, low + 2*s),
+                            median3(array, mid - s, mid, mid + s),
+                            median3(array, high - 2*s, high - s, high))];
+  int i = low;
+  *lt = low;
+  *gt = high;
+
+  while(i <= *gt){
+    if(array[i] < pivot){
+      swap(array, (*lt)++, i++);
+    }
+    else if(array[i] > pivot){
+      swap(array, i, (*gt)--);
+    }
+    else{
+      i++;
+    }
+  }
+}
+
+
+//number of the job's ranks in [low, high]
+static inline int ranks_in(qsort_job_t *job, int low, int high){
+  int lo = low > job->rlo ? low : job->rlo;
+  int hi = high < job->rhi ? high : job->rhi;
+  return hi >= lo ? hi - lo + 1 : 0;
+}
+
+//quicksort a range of a job's array, going only into the parts that
+//hold ranks the job asked for
+//
+//the job may complete (and be freed by qsort_wait) as soon as the last
+//of its ranks is counted, so everything needed from it is read first,
+//and it is only used after a job_progress or push_task while ranks of
+//this range are still uncounted
+void quicksort(qsort_job_t *job, int low, int high){
+  int *array = (int *) job->data;
+  qsort_pool_t *pool = job->pool;
+
+  if(high - low < MINSIZE){
+    int in = ranks_in(job, low, high);
+    bubblesort(array, low, high);
+    TRACE_ADD(sorted, (high - low)+1);
+
+    //update the job's count
+    job_progress(job, in);
+    return;
+  }
+
+  //partition the array
+  TRACE_TIME(t);
+  int lt, gt;
+  partition(array, low, high, &lt, &gt);
+  TRACE_SINCE(t_partition, t);
+  TRACE_ADD(partitions, 1);
+  TRACE_ADD(scanned, (high - low)+1);
+  TRACE_ADD(sorted, (gt - lt)+1);
+
+  int pivot = ranks_in(job, lt, gt);
+  int left = low < lt ? ranks_in(job, low, lt-1) : 0;
+  int right = gt < high ? ranks_in(job, gt+1, high) : 0;
+
+  if (left){
+    //create task and add to queue for next avail thread
+    //for the array elements on the left side of the partition
+    push_task(pool, create_task(job, low, lt-1));
+  }
+
+  //the copies of the pivot are in their final positions
+  if(pivot){
+    job_progress(job, pivot);
+  }
+
+  if (right){
+    //recursively quicksort on the elements
+    //on the right side of the partition
+    quicksort(job, gt+1, high);
+  }
+}
+
+
+void barrier_wait(void *arg){
+  pthread_barrier_wait((pthread_barrier_t *) arg);
+}
+
+//run thread <tid>'s share of a merge (or touch) job
+void merge_task(qsort_job_t *job, int tid){
+  int P = job->pool->num_thread;
+
+  if(job->mode == QSORT_RECORD){
+    rec_parallel(job->data, job->scratch, job->n, tid, P,
+                 barrier_wait, &job->barrier);
+  }
+  else if(job->mode == QSORT_MERGE){
+    int_parallel(job->data, job->scratch, job->n, tid, P,
+                 barrier_wait, &job->barrier);
+  }
+  else{
+    long low = (long) job->n * tid / P, high = (long) job->n * (tid+1) / P;
+    memset((int *) job->data + low, 0, sizeof(int) * (high - low));
+  }
+  job_progress(job, 1);
+}
+
+
+//worker routine that each thread runs until the pool is destroyed
+void *worker(void *arg){
+  qsort_pool_t *pool = ((worker_arg_t *) arg)->pool;
+  long wid = ((worker_arg_t *) arg)->wid;
+  int node = affinity_pin(&pool->affinity, wid);
+#ifdef TRACE
+  my_trace = &pool->traces[wid];
+  my_trace->cpu = sched_getcpu();
+  my_trace->stride = 1;
+  my_trace->begin = trace_now();
+#endif
+  task_t *task;
+
+  for(;;){
+    //sleep until there is a task or the pool shuts down
+    lock_queue(pool);
+    while(pool->queue.length < 1 && !pool->shutdown){
+      wait_queue(pool);
+    }
+    if(pool->queue.length < 1){
+      unlock_queue(pool);
+      break;
+    }
+
+    //get a task (prefer one on this thread's NUMA node if there are
+    //several)
+    if(pool->affinity.nnodes > 1){
+      task = remove_local_task(&pool->queue, node);
+    }
+    else{
+      task = remove_task(&pool->queue);
+    }
+#ifdef TRACE
+    trace_depth(pool->queue.length);
+#endif
+    unlock_queue(pool);
+    TRACE_ADD(tasks, 1);
+
+    if(task->job->mode == QSORT_QUICK){
+      quicksort(task->job, task->low, task->high);
+    }
+    else{
+      merge_task(task->job, task->low);
+    }
+    free(task);
+  }
+
+#ifdef TRACE
+  my_trace->end = trace_now();
+#endif
+  return NULL;
+}
+//----------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------
+//Public interface
+
+qsort_pool_t *qsort_pool_create(int num_thread, const char *policy){
+  qsort_pool_t *pool = (qsort_pool_t *) calloc(1, sizeof(qsort_pool_t));
+  worker_arg_t *args;
+
+  if(num_thread < 1 || affinity_init(&pool->affinity, policy) < 0){
+    free(pool);
+    return NULL;
+  }
+  pool->num_thread = num_thread;
+  pthread_mutex_init(&pool->queue_lock, NULL);
+  pthread_cond_init(&pool->length_cond, NULL);
+
+#ifdef TRACE
+  pool->traces = (trace_t *) aligned_alloc(64, sizeof(trace_t) * num_thread);
+  memset(pool->traces, 0, sizeof(trace_t) * num_thread);
+  pool->trace_epoch = trace_now();
+#endif
+
+  //the arguments live as long as the pool
+  pool->threads = (pthread_t *) malloc(sizeof(pthread_t) * num_thread);
+  pool->args = args = (worker_arg_t *) malloc(sizeof(worker_arg_t) * num_thread);
+  for(long k = 0; k < num_thread; k++){
+    args[k].pool = pool;
+    args[k].wid = k;
+    pthread_create(&pool->threads[k], NULL, worker, &args[k]);
+  }
+  return pool;
+}
+
+//set up a job (quicksort jobs put ranks lo..hi in place); gang jobs
+//queue one task per worker, all at once
+static qsort_job_t *submit(qsort_pool_t *pool, void *data, int n, int mode,
+                           int lo, int hi){
+  qsort_job_t *job = (qsort_job_t *) calloc(1, sizeof(qsort_job_t));
+  int P = pool->num_thread;
+
+  job->pool = pool;
+  job->mode = mode;
+  job->data = data;
+  job->n = n;
+  job->rlo = lo;
+  job->rhi = hi;
+  pthread_mutex_init(&job->lock, NULL);
+  pthread_cond_init(&job->done_cond, NULL);
+
+  if(mode == QSORT_QUICK){
+    job->target = job->rhi - job->rlo + 1;
+    job->done = (job->target < 1);
+    if(job->target > 0){
+      pthread_mutex_lock(&pool->queue_lock);
+      add_task(&pool->queue, create_task(job, 0, n-1));
+      pthread_cond_signal(&pool->length_cond);
+      pthread_mutex_unlock(&pool->queue_lock);
+    }
+    return job;
+  }
+
+  if(mode == QSORT_MERGE){
+    job->scratch = malloc(sizeof(int) * n);
+  }
+  else if(mode == QSORT_RECORD){
+    job->scratch = malloc(sizeof(record_t) * n);
+  }
+  pthread_barrier_init(&job->barrier, NULL, P);
+  job->target = P;
+  pthread_mutex_lock(&pool->queue_lock);
+  for(int tid = 0; tid < P; tid++){
+    add_task(&pool->queue, create_task(job, tid, tid));
+  }
+  pthread_cond_broadcast(&pool->length_cond);
+  pthread_mutex_unlock(&pool->queue_lock);
+  return job;
+}
+
+qsort_job_t *qsort_submit(qsort_pool_t *pool, void *data, int n, int mode){
+  return submit(pool, data, n, mode, 0, n-1);
+}
+
+qsort_job_t *qsort_submit_ranks(qsort_pool_t *pool, int *data, int n,
+                                int lo, int hi){
+  return submit(pool, data, n, QSORT_QUICK, lo < 0 ? 0 : lo,
+                hi >= n ? n-1 : hi);
+}
+
+void qsort_pool_touch(qsort_pool_t *pool, int *array, int n){
+  qsort_wait(submit(pool, array, n, QSORT_TOUCH, 0, n-1));
+}
+
+int qsort_test(qsort_job_t *job){
+  pthread_mutex_lock(&job->lock);
+  int done = job->done;
+  pthread_mutex_unlock(&job->lock);
+  return done;
+}
+
+void qsort_wait(qsort_job_t *job){
+  pthread_mutex_lock(&job->lock);
+  while(!job->done){
+    pthread_cond_wait(&job->done_cond, &job->lock);
+  }
+  pthread_mutex_unlock(&job->lock);
+
+  if(job->mode != QSORT_QUICK){
+    pthread_barrier_destroy(&job->barrier);
+  }
+  pthread_mutex_destroy(&job->lock);
+  pthread_cond_destroy(&job->done_cond);
+  free(job->scratch);
+  free(job);
+}
+
+void qsort_pool_destroy(qsort_pool_t *pool){
+  pthread_mutex_lock(&pool->queue_lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->length_cond);
+  pthread_mutex_unlock(&pool->queue_lock);
+
+  for(int k = 0; k < pool->num_thread; k++){
+    pthread_join(pool->threads[k], NULL);
+  }
+
+#ifdef TRACE
+  trace_dump(pool->traces, pool->num_thread, pool->trace_epoch);
+  free(pool->traces);
+#endif
+  pthread_mutex_destroy(&pool->queue_lock);
+  pthread_cond_destroy(&pool->length_cond);
+  affinity_free(&pool->affinity);
+  free(pool->threads);
+  free(pool->args);
+  free(pool);
+}
+//----------------------------------------------------------------------
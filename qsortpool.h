@@ -0,0 +1,73 @@
+// Persistent pthread sorting pool.
+//
+// A pool starts its worker threads once and then sorts any number of
+// jobs; a job is submitted without blocking and returns a handle that
+// is waited on (or polled) for completion.  Several jobs may be in the
+// pool at the same time, from one caller or several.  Idle workers
+// sleep on a condition variable.
+//
+// Modes:
+//   QSORT_QUICK   quicksort of an int array; partitions are queued as
+//                 tasks that any worker may take
+//   QSORT_MERGE   parallel stable merge sort of an int array (msort.h),
+//                 run by all workers of the pool together
+//   QSORT_RECORD  the same for an array of record_t, by key
+//
+// qsort_submit_ranks() is the quicksort restricted to a window of
+// ranks: a partitioned range is only split further if it holds ranks
+// in the window, so selecting the median or the k smallest costs
+// about O(N) + O(k log k) instead of a full sort.
+//
+// Workers are pinned by an affinity policy (affinity.h).  With more
+// than one NUMA node, a worker prefers queued partitions whose range
+// starts on its own node, assuming the array was first touched in
+// equal blocks by the workers in order (qsort_pool_touch does that).
+//
+// Compile qsortpool.c with -DTRACE for per-worker counters, written in
+// Chrome trace format to $QSORT_TRACE (default qsort_trace.json) when
+// the pool is destroyed.
+//
+// Usage:
+//   linux> gcc -pthread -o qsortpthd 01_qsortpthd.c qsortpool.c -lm
+//
+#ifndef QSORTPOOL_H
+#define QSORTPOOL_H
+
+#include "msort.h"	// record_t
+
+enum { QSORT_QUICK, QSORT_MERGE, QSORT_RECORD };
+
+typedef struct qsort_pool_ qsort_pool_t;
+typedef struct qsort_job_ qsort_job_t;
+
+// Start num_thread workers placed by <policy>.  Return NULL on a bad
+// policy.
+qsort_pool_t *qsort_pool_create(int num_thread, const char *policy);
+
+// Let the workers zero array[0..n-1] block by block, so its pages are
+// placed on their NUMA nodes.  Returns when done.
+void qsort_pool_touch(qsort_pool_t *pool, int *array, int n);
+
+// Sort data[0..n-1] (int, or record_t in QSORT_RECORD mode).  Returns
+// at once; data must not be touched until the job has completed.
+qsort_job_t *qsort_submit(qsort_pool_t *pool, void *data, int n, int mode);
+
+// Partially sort int data[0..n-1]: the elements of ranks lo..hi
+// (0-based) end up sorted in data[lo..hi], everything smaller before
+// them and everything larger after.  lo == hi is quickselect
+// (nth_element), lo = 0 keeps the hi+1 smallest, hi = n-1 the n-lo
+// largest.
+qsort_job_t *qsort_submit_ranks(qsort_pool_t *pool, int *data, int n,
+                                int lo, int hi);
+
+// Nonzero once the job has completed.
+int qsort_test(qsort_job_t *job);
+
+// Wait for the job to complete and free the handle.
+void qsort_wait(qsort_job_t *job);
+
+// Stop the workers and free the pool.  Every job submitted must have
+// been waited for.
+void qsort_pool_destroy(qsort_pool_t *pool);
+
+#endif
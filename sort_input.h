@@ -0,0 +1,115 @@
+// Reproducible input generation shared by the sort programs.
+//
+// Every distribution is driven by a seeded splitmix64 generator, so the
+// same <dist, seed, N> always gives the same array on every machine.
+// Values are in 1..N like the original random input, but nothing
+// relies on that any more: the sorters verify order and a checksum of
+// the input, and extsort samples its splitters.  Programs including
+// this file link with -lm (zipf uses log and exp).
+//
+//   random     random permutation of [1..N] (the original input)
+//   sorted     1, 2, ..., N
+//   reverse    N, N-1, ..., 1
+//   fewunique  16 distinct values in random order
+//   zipf       Zipf(1)-like skew: value k appears about 1/k as often
+//   organpipe  1, 2, ..., N/2, N/2, ..., 2, 1
+//   file:path  the first N ints of a binary file
+//
+#ifndef SORT_INPUT_H
+#define SORT_INPUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define FEWUNIQUE 16	// distinct values in the fewunique input
+
+// splitmix64 step
+static inline uint64_t rng_next(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// uniform double in [0, 1)
+static inline double rng_double(uint64_t *state) {
+  return (rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// wall clock time in seconds
+static inline double wall_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Fill array[0..N-1] with input distribution <dist> from <seed>.
+// Return 0 on success, -1 (with a message) on a bad distribution name
+// or an unreadable/short file.
+//
+static int gen_input(int *array, int N, const char *dist, uint64_t seed) {
+  uint64_t s = seed;
+
+  if (strcmp(dist, "random") == 0) {
+    for (int i = 0; i < N; i++)
+      array[i] = i + 1;
+    for (int i = N-1; i > 0; i--) {
+      int j = (int) (rng_next(&s) % (uint64_t) (i + 1));
+      int tmp = array[i];
+      array[i] = array[j];
+      array[j] = tmp;
+    }
+  }
+  else if (strcmp(dist, "sorted") == 0) {
+    for (int i = 0; i < N; i++)
+      array[i] = i + 1;
+  }
+  else if (strcmp(dist, "reverse") == 0) {
+    for (int i = 0; i < N; i++)
+      array[i] = N - i;
+  }
+  else if (strcmp(dist, "fewunique") == 0) {
+    int step = N / FEWUNIQUE > 0 ? N / FEWUNIQUE : 1;
+    for (int i = 0; i < N; i++)
+      array[i] = 1 + (int) (rng_next(&s) % FEWUNIQUE) * step % N;
+  }
+  else if (strcmp(dist, "zipf") == 0) {
+    // inverse CDF of the continuous 1/x density on [1, N+1)
+    double lnN = log((double) N + 1.0);
+    for (int i = 0; i < N; i++) {
+      int v = (int) exp(rng_double(&s) * lnN);
+      array[i] = v < 1 ? 1 : (v > N ? N : v);
+    }
+  }
+  else if (strcmp(dist, "organpipe") == 0) {
+    for (int i = 0; i < N; i++)
+      array[i] = i < (N+1)/2 ? i + 1 : N - i;
+  }
+  else if (strncmp(dist, "file:", 5) == 0) {
+    FILE *f = fopen(dist + 5, "rb");
+    if (!f) {
+      printf("Cannot open input file %s\n", dist + 5);
+      return -1;
+    }
+    size_t got = fread(array, sizeof(int), N, f);
+    fclose(f);
+    if (got != (size_t) N) {
+      printf("Input file %s holds fewer than %d ints\n", dist + 5, N);
+      return -1;
+    }
+  }
+  else {
+    printf("Unknown input distribution %s\n"
+           "(random, sorted, reverse, fewunique, zipf, organpipe, "
+           "file:<path>)\n", dist);
+    return -1;
+  }
+
+  return 0;
+}
+
+#endif
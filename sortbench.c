@@ -0,0 +1,233 @@
+// Benchmark driver for the sort programs.
+//
+// For every N in the sweep, the input is generated once from a fixed
+// distribution and seed (sort_input.h).  Two single-thread baselines
+// run in-process on a copy of it: the C library qsort() ("serial") and
+// an LSD radix sort ("radix").  The pthread and OpenMP sorters are then
+// run for every thread count with the same -d/-s options, and their
+// own "Sort time:" line is parsed from their output.  Each measurement
+// is the best of <reps> runs.
+//
+// Output is CSV on stdout:
+//   sorter,dist,seed,N,threads,time_s,elements_per_s,speedup,verified
+// where speedup is relative to the serial baseline for the same N.
+//
+// Usage: ./sortbench [-d <dist>] [-s <seed>] [-r <reps>]
+//                    [-n <N,N,...>] [-t <T,T,...>]
+//                    [-P <pthread sorter>] [-O <openmp sorter>]
+//        ./sortbench -g <file> [-d <dist>] [-s <seed>] -n <N>
+//
+// -g writes the generated input to <file> as binary ints instead (for
+// extsort, or for -d file:<file> later) and exits.
+//
+// Compile with (-lm for the zipf input in sort_input.h):
+//   gcc -o sortbench sortbench.c -lm
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include "sort_input.h"
+
+#define MAXLIST 64	// longest -n / -t list
+#define CMDLEN 1024
+
+// parse a comma separated list of ints, return how many were found
+int parse_list(const char *arg, long *list) {
+  int cnt = 0;
+  char *end;
+  while (*arg && cnt < MAXLIST) {
+    list[cnt++] = strtol(arg, &end, 10);
+    if (*end != ',')
+      break;
+    arg = end + 1;
+  }
+  return cnt;
+}
+
+// compare ints for qsort()
+int cmp_int(const void *a, const void *b) {
+  int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+// LSD radix sort, 8 bits per pass.  The sign bit is flipped so that
+// negative keys (possible with file input) sort first.
+//
+void radixsort(int *array, int N) {
+  uint32_t *a = (uint32_t *) array;
+  uint32_t *tmp = (uint32_t *) malloc(sizeof(uint32_t) * N);
+  size_t cnt[256];
+
+  for (int shift = 0; shift < 32; shift += 8) {
+    memset(cnt, 0, sizeof(cnt));
+    for (int i = 0; i < N; i++)
+      cnt[((a[i] ^ 0x80000000u) >> shift) & 0xFF]++;
+    size_t sum = 0;
+    for (int d = 0; d < 256; d++) {
+      size_t c = cnt[d];
+      cnt[d] = sum;
+      sum += c;
+    }
+    for (int i = 0; i < N; i++)
+      tmp[cnt[((a[i] ^ 0x80000000u) >> shift) & 0xFF]++] = a[i];
+    memcpy(a, tmp, sizeof(uint32_t) * N);
+  }
+  free(tmp);
+}
+
+int is_sorted(int *array, int N) {
+  for (int i = 0; i < N-1; i++)
+    if (array[i] > array[i+1])
+      return 0;
+  return 1;
+}
+
+// Run an in-process baseline <reps> times on a copy of input.
+// Return the best time, set *ok if every run sorted correctly.
+//
+double run_baseline(const char *name, int *input, int N, int reps, int *ok) {
+  int *work = (int *) malloc(sizeof(int) * N);
+  double best = -1.0;
+
+  *ok = 1;
+  for (int r = 0; r < reps; r++) {
+    memcpy(work, input, sizeof(int) * N);
+    double t = wall_time();
+    if (strcmp(name, "radix") == 0)
+      radixsort(work, N);
+    else
+      qsort(work, N, sizeof(int), cmp_int);
+    t = wall_time() - t;
+    if (best < 0 || t < best)
+      best = t;
+    *ok &= is_sorted(work, N);
+  }
+  free(work);
+  return best;
+}
+
+// Run an external sorter <reps> times.  Return the best reported sort
+// time, or -1 if it never reported one; set *ok if every run verified.
+//
+double run_program(const char *prog, const char *dist, uint64_t seed,
+                   int N, int threads, int reps, int *ok) {
+  char cmd[CMDLEN], line[256];
+  double best = -1.0, t;
+
+  *ok = 1;
+  snprintf(cmd, CMDLEN, "%s -d '%s' -s %llu %d %d", prog, dist,
+           (unsigned long long) seed, N, threads);
+  for (int r = 0; r < reps; r++) {
+    FILE *p = popen(cmd, "r");
+    int verified = 0;
+    if (!p) {
+      *ok = 0;
+      return -1.0;
+    }
+    while (fgets(line, sizeof(line), p)) {
+      if (sscanf(line, "Sort time: %lf", &t) == 1 && (best < 0 || t < best))
+        best = t;
+      if (strncmp(line, "Result verified!", 16) == 0)
+        verified = 1;
+    }
+    pclose(p);
+    *ok &= verified;
+  }
+  return best;
+}
+
+void print_row(const char *sorter, const char *dist, uint64_t seed, int N,
+               int threads, double t, double base, int ok) {
+  if (t < 0) {
+    printf("%s,%s,%llu,%d,%d,,,,error\n", sorter, dist,
+           (unsigned long long) seed, N, threads);
+    return;
+  }
+  printf("%s,%s,%llu,%d,%d,%.6f,%.0f,%.3f,%s\n", sorter, dist,
+         (unsigned long long) seed, N, threads, t, N / t, base / t,
+         ok ? "yes" : "no");
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  const char *dist = "random";
+  const char *pthread_prog = "./qsortpthd";
+  const char *omp_prog = "./qsort_omp";
+  const char *genfile = NULL;
+  uint64_t seed = 1;
+  int reps = 3;
+  long sizes[MAXLIST] = {1000000};
+  long threads[MAXLIST] = {1, 2, 4, 8};
+  int nsizes = 1, nthreads = 4;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:s:r:n:t:P:O:g:")) != -1) {
+    switch (opt) {
+    case 'd': dist = optarg; break;
+    case 's': seed = strtoull(optarg, NULL, 10); break;
+    case 'r': reps = atoi(optarg); break;
+    case 'n': nsizes = parse_list(optarg, sizes); break;
+    case 't': nthreads = parse_list(optarg, threads); break;
+    case 'P': pthread_prog = optarg; break;
+    case 'O': omp_prog = optarg; break;
+    case 'g': genfile = optarg; break;
+    default:
+      printf("Usage: ./sortbench [-d <dist>] [-s <seed>] [-r <reps>] "
+             "[-n <N,...>] [-t <T,...>] [-P <prog>] [-O <prog>]\n"
+             "       ./sortbench -g <file> [-d <dist>] [-s <seed>] -n <N>\n");
+      exit(0);
+    }
+  }
+  if (reps < 1)
+    reps = 1;
+  for (int i = 0; i < nsizes; i++) {
+    if (sizes[i] < 2 || sizes[i] > INT32_MAX) {
+      printf("<N> must be at least 2\n");
+      exit(0);
+    }
+  }
+
+  if (genfile) {
+    int N = (int) sizes[0];
+    int *input = (int *) malloc(sizeof(int) * N);
+    if (gen_input(input, N, dist, seed) < 0)
+      exit(1);
+    FILE *f = fopen(genfile, "wb");
+    if (!f || fwrite(input, sizeof(int), N, f) != (size_t) N) {
+      printf("Cannot write %s\n", genfile);
+      exit(1);
+    }
+    fclose(f);
+    free(input);
+    return 0;
+  }
+
+  printf("sorter,dist,seed,N,threads,time_s,elements_per_s,speedup,verified\n");
+
+  for (int i = 0; i < nsizes; i++) {
+    int N = (int) sizes[i];
+    int ok;
+    int *input = (int *) malloc(sizeof(int) * N);
+    if (gen_input(input, N, dist, seed) < 0)
+      exit(1);
+
+    double base = run_baseline("serial", input, N, reps, &ok);
+    print_row("serial", dist, seed, N, 1, base, base, ok);
+
+    double t = run_baseline("radix", input, N, reps, &ok);
+    print_row("radix", dist, seed, N, 1, t, base, ok);
+    free(input);
+
+    for (int j = 0; j < nthreads; j++) {
+      t = run_program(pthread_prog, dist, seed, N, threads[j], reps, &ok);
+      print_row("pthread", dist, seed, N, threads[j], t, base, ok);
+
+      t = run_program(omp_prog, dist, seed, N, threads[j], reps, &ok);
+      print_row("openmp", dist, seed, N, threads[j], t, base, ok);
+    }
+  }
+
+  return 0;
+}